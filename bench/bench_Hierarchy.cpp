@@ -0,0 +1,284 @@
+// bench_Hierarchy.cpp
+/**\file measure operations with hierarchy of Items
+ *
+ * Usage: bench_hierarchy [--depth N] [--breadth N] [--items N] [--repeats N]
+ *
+ * Every operation is measured on three shapes of hierarchy:
+ * - chain: `items` Items, every Item has one child
+ * - fan: root with `items` children
+ * - tree: every Item (except leafs) has `breadth` children, depth of the tree
+ * is `depth`
+ *
+ * Root of every hierarchy is placed on a Scene. Also construction and
+ * destruction of single Items are measured by batches. Results are printed in
+ * JSON to stdout
+ */
+
+#include "bench_auxilary.hpp"
+#include "svc/AbstractItem.hpp"
+#include "svc/Scene.hpp"
+#include <functional>
+#include <iostream>
+#include <random>
+
+#define DEFAULT_DEPTH   6
+#define DEFAULT_BREADTH 6
+#define DEFAULT_ITEMS   1000
+#define DEFAULT_REPEATS 50
+
+#define TEARDOWN_REPEATS 5
+
+#define LIFETIME_BATCH_SIZE 1000
+
+/// prevents optimizing out results of measured calls
+static volatile float sink;
+
+namespace svc {
+class AbstractVisitor {};
+} // namespace svc
+
+class BenchItem final : public svc::AbstractItem {
+public:
+  svc::Box getBoundingBox() const noexcept override {
+    return {{-5, -5}, {5, 5}};
+  }
+
+  void accept([[maybe_unused]] svc::AbstractVisitor *visitor) override {
+  }
+
+  using AbstractItem::getSceneMatrix;
+};
+
+struct Shape {
+  std::string name;
+  size_t      depth;
+  size_t      breadth;
+};
+
+/**\brief call the callback for every pair parent-child in breadth-first
+ * order, so parent always is called before its children
+ */
+static void forEachEdge(
+    const Shape &shape,
+    const std::function<void(svc::ItemPtr &parent, svc::ItemPtr &child)>
+        &callback) {
+  std::mt19937                          engine{42};
+  std::uniform_real_distribution<float> offset{-100, 100};
+
+  std::vector<svc::ItemPtr> level{std::make_shared<BenchItem>()};
+  for (size_t depth = 0; depth < shape.depth; ++depth) {
+    std::vector<svc::ItemPtr> next;
+    for (svc::ItemPtr &parent : level) {
+      for (size_t i = 0; i < shape.breadth; ++i) {
+        svc::ItemPtr child = std::make_shared<BenchItem>();
+        child->setPos(svc::Point{offset(engine), offset(engine)});
+        callback(parent, child);
+        next.emplace_back(std::move(child));
+      }
+    }
+    level = std::move(next);
+  }
+}
+
+static void benchShape(bench::Report &report,
+                       const Shape &  shape,
+                       size_t         repeats) {
+  using Params   = std::vector<std::pair<std::string, std::string>>;
+  using Counters = std::vector<std::pair<std::string, double>>;
+
+  Params params{{"shape", shape.name}};
+
+  std::shared_ptr<svc::Scene> scene = std::make_shared<svc::Scene>();
+  svc::ItemPtr                root;
+  std::vector<svc::ItemPtr>   nodes;
+
+  { // build
+    bench::Result result{"appendChild", params, {}, {}};
+    forEachEdge(shape, [&](svc::ItemPtr &parent, svc::ItemPtr &child) {
+      if (root == nullptr) {
+        root = parent;
+        scene->appendItem(root);
+        nodes.emplace_back(root);
+      }
+
+      bench::measure(result.samples, [&parent, &child]() {
+        parent->appendChild(child);
+      });
+      nodes.emplace_back(child);
+    });
+    result.counters = Counters{{"depth", shape.depth},
+                               {"breadth", shape.breadth},
+                               {"items", nodes.size()}};
+    report.append(std::move(result));
+  }
+
+  Counters counters{{"depth", shape.depth},
+                    {"breadth", shape.breadth},
+                    {"items", nodes.size()}};
+
+  { // scene matrix of every Item
+    bench::Result result{"getSceneMatrix", params, {}, counters};
+    result.samples.reserve(nodes.size());
+    for (svc::ItemPtr &node : nodes) {
+      BenchItem *item = static_cast<BenchItem *>(node.get());
+
+      bench::measure(result.samples, [item]() {
+        sink = item->getSceneMatrix().a[0][0];
+      });
+    }
+    report.append(std::move(result));
+  }
+
+  { // move root with all descendants
+    bench::Result result{"setScenePos(root)", params, {}, counters};
+    result.samples.reserve(repeats);
+    for (size_t i = 0; i < repeats; ++i) {
+      svc::Point pos{float(i), float(i)};
+      bench::measure(result.samples, [&root, pos]() {
+        root->setScenePos(pos);
+      });
+    }
+    report.append(std::move(result));
+  }
+
+  { // detach and attach subtrees of the root
+    bench::Result removeResult{"removeChild(subtree)", params, {}, counters};
+    bench::Result appendResult{"appendChild(subtree)", params, {}, counters};
+    removeResult.samples.reserve(repeats);
+    appendResult.samples.reserve(repeats);
+
+    for (size_t i = 0; i < repeats; ++i) {
+      svc::ItemPtr subtree = *root->getChildrenRange().begin();
+      bench::measure(removeResult.samples, [&root, &subtree]() {
+        root->removeChild(subtree.get());
+      });
+      bench::measure(appendResult.samples, [&root, &subtree]() {
+        root->appendChild(subtree);
+      });
+    }
+
+    report.append(std::move(removeResult));
+    report.append(std::move(appendResult));
+  }
+
+  { // reparent leaf inside the Scene and move the leaf
+    bench::Result reparentResult{"appendChild(reparent)", params, {}, counters};
+    bench::Result moveResult{"setScenePos(reparented)", params, {}, counters};
+    reparentResult.samples.reserve(repeats);
+    moveResult.samples.reserve(repeats);
+
+    // XXX the leaf is moved in turn between its parent and first child of the
+    // root, which can't be a descendant of the leaf
+    svc::ItemPtr       leaf      = nodes.back();
+    svc::AbstractItem *parents[] = {nodes[1].get(), leaf->getParent()};
+
+    for (size_t i = 0; i < repeats; ++i) {
+      svc::AbstractItem *parent = parents[i % 2];
+      bench::measure(reparentResult.samples, [parent, &leaf]() {
+        parent->appendChild(leaf);
+      });
+
+      svc::Point pos{float(i), float(i)};
+      bench::measure(moveResult.samples, [&leaf, pos]() {
+        leaf->setScenePos(pos);
+      });
+    }
+
+    report.append(std::move(reparentResult));
+    report.append(std::move(moveResult));
+  }
+
+  { // remove all Items from leafs to root
+    bench::Result result{"removeChild", params, {}, counters};
+    result.samples.reserve(nodes.size());
+    for (auto iter = nodes.rbegin(); iter != nodes.rend(); ++iter) {
+      svc::AbstractItem *item   = iter->get();
+      svc::AbstractItem *parent = item->getParent();
+      if (parent == nullptr) {
+        continue;
+      }
+
+      bench::measure(result.samples, [parent, item]() {
+        parent->removeChild(item);
+      });
+    }
+    report.append(std::move(result));
+  }
+
+  nodes.clear();
+  root.reset();
+
+  { // destroy whole hierarchy, which is not placed on a Scene
+    bench::Result result{"~AbstractItem", params, {}, counters};
+    for (size_t i = 0; i < TEARDOWN_REPEATS; ++i) {
+      svc::ItemPtr hierarchy;
+      forEachEdge(shape, [&hierarchy](svc::ItemPtr &parent,
+                                      svc::ItemPtr &child) {
+        if (hierarchy == nullptr) {
+          hierarchy = parent;
+        }
+        parent->appendChild(child);
+      });
+
+      bench::measure(result.samples, [&hierarchy]() {
+        hierarchy.reset();
+      });
+    }
+    report.append(std::move(result));
+  }
+}
+
+/**\brief construct and destroy Items without parent by batches, every batch
+ * is measured as one sample
+ */
+static void benchLifetime(bench::Report &report, size_t repeats) {
+  bench::Result constructResult{"AbstractItem()", {}, {}, {}};
+  bench::Result destroyResult{"~AbstractItem(leaf)", {}, {}, {}};
+
+  std::vector<svc::ItemPtr> batch;
+  batch.reserve(LIFETIME_BATCH_SIZE);
+  for (size_t i = 0; i < repeats; ++i) {
+    bench::measure(constructResult.samples, [&batch]() {
+      for (size_t j = 0; j < LIFETIME_BATCH_SIZE; ++j) {
+        batch.emplace_back(std::make_shared<BenchItem>());
+      }
+    });
+    bench::measure(destroyResult.samples, [&batch]() {
+      batch.clear();
+    });
+  }
+
+  for (bench::Result *result : {&constructResult, &destroyResult}) {
+    result->counters = {{"batch_size", LIFETIME_BATCH_SIZE},
+                        {"ns_per_item",
+                         result->samples.total() * 1e9 /
+                             (repeats * LIFETIME_BATCH_SIZE)}};
+    report.append(std::move(*result));
+  }
+}
+
+int main(int argc, char *argv[]) {
+  bench::Arguments args{argc, argv};
+
+  size_t depth   = args.get("depth", size_t{DEFAULT_DEPTH});
+  size_t breadth = args.get("breadth", size_t{DEFAULT_BREADTH});
+  size_t items   = args.get("items", size_t{DEFAULT_ITEMS});
+  size_t repeats = args.get("repeats", size_t{DEFAULT_REPEATS});
+
+  bench::Report report{"bench_hierarchy"};
+
+  for (const Shape &shape : {Shape{"chain", items, 1},
+                             Shape{"fan", 1, items},
+                             Shape{"tree", depth, breadth}}) {
+    std::cerr << "bench_hierarchy: " << shape.name << std::endl;
+
+    benchShape(report, shape, repeats);
+  }
+
+  std::cerr << "bench_hierarchy: lifetime" << std::endl;
+  benchLifetime(report, repeats);
+
+  report.write(std::cout);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,159 @@
+// bench_Logs.cpp
+/**\file measure cost of one log record for different loggers
+ *
+ * Usage: bench_logs [--records N] [--threads N]
+ *
+ * Loggers:
+ * - text: formatting of record by `getRecord` (without writing)
+ * - async: AsyncLogger writing to a string stream
+ * - async_deferred: same as async, but user message is formatted by background
+ *   thread (`LOG_ASYNC_C`)
+ * - binary: BinaryLogger writing to a temporary file
+ *
+ * Records are measured by batches, because single record of binary log is
+ * cheaper then reading of clock. Results are printed in JSON to stdout
+ */
+
+#include "async_logs.hpp"
+#include "bench_auxilary.hpp"
+#include "binary_logs.hpp"
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <sstream>
+
+#define DEFAULT_RECORDS 1000000
+#define DEFAULT_THREADS 1
+
+#define BATCH_SIZE 1000
+
+/// size of binary log for one record (with reserve for format definitions)
+#define BINARY_RECORD_SIZE 64
+
+/// prevents optimizing out results of measured calls
+static volatile size_t sink;
+
+/**\brief write records by several threads, every thread measures its batches
+ */
+static void benchLogger(bench::Report &                          report,
+                        const std::string &                      name,
+                        size_t                                   records,
+                        size_t                                   threads,
+                        const std::function<void(size_t record)> &write) {
+  std::vector<bench::Samples> samples(threads);
+  std::vector<std::thread>    workers;
+
+  size_t batches = records / threads / BATCH_SIZE;
+  for (size_t t = 0; t < threads; ++t) {
+    workers.emplace_back([&samples, &write, batches, t]() {
+      samples[t].reserve(batches);
+      for (size_t batch = 0; batch < batches; ++batch) {
+        bench::measure(samples[t], [&write, batch]() {
+          for (size_t i = 0; i < BATCH_SIZE; ++i) {
+            write(batch * BATCH_SIZE + i);
+          }
+        });
+      }
+    });
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+
+  double total = 0;
+  for (bench::Samples &threadSamples : samples) {
+    total += threadSamples.total();
+  }
+
+  // XXX latencies are reported only for first thread, but time of record is
+  // average for all threads
+  bench::Result result{"batch",
+                       {{"logger", name}},
+                       std::move(samples.front()),
+                       {{"threads", threads},
+                        {"batch_size", BATCH_SIZE},
+                        {"ns_per_record",
+                         total * 1e9 / (batches * threads * BATCH_SIZE)}}};
+
+  report.append(std::move(result));
+}
+
+int main(int argc, char *argv[]) {
+  bench::Arguments args{argc, argv};
+
+  size_t records = args.get("records", size_t{DEFAULT_RECORDS});
+  size_t threads = args.get("threads", size_t{DEFAULT_THREADS});
+
+  bench::Report report{"bench_logs"};
+
+  // info records are disabled by default if NDEBUG defined
+  logs::CategoryRegistry::get().setThreshold("bench", logs::Severity::Info);
+
+  std::cerr << "bench_logs: text" << std::endl;
+  benchLogger(report, "text", records, threads, [](size_t record) {
+    sink = logs::getRecord(logs::Severity::Info,
+                           __FILE__,
+                           __LINE__,
+                           __func__,
+                           GET_LOG_TIME(),
+                           GET_LOG_THREAD_ID(),
+                           logs::messageHandler("record %1% of %2%",
+                                                record,
+                                                "bench"))
+               .size();
+  });
+
+  std::cerr << "bench_logs: async" << std::endl;
+  {
+    std::ostringstream out;
+    logs::AsyncLogger  logger{out,
+                             ASYNC_LOG_DEFAULT_CAPACITY,
+                             logs::OverflowPolicy::Block};
+    logs::LoggerFactory::set(&logger);
+    benchLogger(report, "async", records, threads, [](size_t record) {
+      LOG_INFO_C("bench", "record %1% of %2%", record, "bench");
+    });
+    logs::LoggerFactory::set(nullptr);
+  }
+
+  std::cerr << "bench_logs: async_deferred" << std::endl;
+  {
+    std::ostringstream out;
+    logs::AsyncLogger  logger{out,
+                             ASYNC_LOG_DEFAULT_CAPACITY,
+                             logs::OverflowPolicy::Block};
+    logs::LoggerFactory::set(&logger);
+    benchLogger(report, "async_deferred", records, threads, [](size_t record) {
+      LOG_ASYNC_C(logs::Severity::Info,
+                  "bench",
+                  "record %1% of %2%",
+                  record,
+                  "bench");
+    });
+    logs::LoggerFactory::set(nullptr);
+  }
+
+  std::cerr << "bench_logs: binary" << std::endl;
+  {
+    std::string fileName = "bench_logs.blog";
+    {
+      logs::BinaryLogger logger{fileName, records * BINARY_RECORD_SIZE};
+      logs::BinaryLoggerFactory::set(&logger);
+      benchLogger(report, "binary", records, threads, [](size_t record) {
+        LOG_BINARY(logs::Severity::Info, "record %1% of %2%", record, "bench");
+      });
+      logs::BinaryLoggerFactory::set(nullptr);
+
+      report.append(bench::Result{"file",
+                                  {{"logger", "binary"}},
+                                  {},
+                                  {{"bytes", logger.size()},
+                                   {"dropped", logger.dropped()}}});
+    }
+    std::remove(fileName.c_str());
+  }
+
+  report.write(std::cout);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,291 @@
+// bench_Scene.cpp
+/**\file measure operations of the Scene at scale
+ *
+ * Usage: bench_scene [--max-items N] [--queries N]
+ *
+ * Items count grows from 1e3 to `max-items` (1e6 by default, 1e7 at most) by
+ * order of magnitude. Every count is measured over uniform, clustered and
+ * skewed-size distributions of Items. Results are printed in JSON to stdout
+ */
+
+#include "bench_auxilary.hpp"
+#include "svc/AbstractItem.hpp"
+#include "svc/AbstractView.hpp"
+#include "svc/Scene.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+#define MIN_ITEMS_COUNT     1000
+#define MAX_ITEMS_COUNT     10000000
+#define DEFAULT_ITEMS_COUNT 1000000
+#define DEFAULT_QUERIES     1000
+
+/// distance between neighbour Items in uniform distribution
+#define ITEMS_SPACING 100
+#define ITEM_SIZE     10
+#define VIEW_SIZE     1000
+
+class BenchItem;
+
+namespace svc {
+class AbstractVisitor {
+public:
+  virtual ~AbstractVisitor()          = default;
+  virtual void visit(BenchItem *item) = 0;
+};
+} // namespace svc
+
+class BenchItem final : public svc::AbstractItem {
+public:
+  explicit BenchItem(float size) noexcept
+      : box_{{-size / 2, -size / 2}, {size / 2, size / 2}} {
+  }
+
+  svc::Box getBoundingBox() const noexcept override {
+    return box_;
+  }
+
+  void accept(svc::AbstractVisitor *visitor) override {
+    visitor->visit(this);
+  }
+
+private:
+  svc::Box box_;
+};
+
+class CountVisitor final : public svc::AbstractVisitor {
+public:
+  void visit([[maybe_unused]] BenchItem *item) override {
+    ++count_;
+  }
+
+  size_t count_ = 0;
+};
+
+class View final : public svc::AbstractView {
+public:
+  svc::Size size() const noexcept override {
+    return {VIEW_SIZE, VIEW_SIZE};
+  }
+};
+
+enum class Distribution { Uniform, Clustered, Skewed };
+
+static const char *toString(Distribution distribution) noexcept {
+  switch (distribution) {
+  case Distribution::Uniform:
+    return "uniform";
+  case Distribution::Clustered:
+    return "clustered";
+  case Distribution::Skewed:
+    return "skewed";
+  }
+  return "";
+}
+
+/**\brief generates positions and sizes of Items. Density of Items doesn't
+ * depend on their count, so results for different counts are comparable
+ */
+class Generator {
+public:
+  Generator(Distribution distribution, size_t count)
+      : distribution_{distribution}
+      , side_{float(std::sqrt(count) * ITEMS_SPACING)}
+      , engine_{count}
+      , uniform_{0, side_} {
+    // every cluster contains about 1000 Items
+    size_t clusters = std::max<size_t>(1, count / 1000);
+    for (size_t i = 0; i < clusters; ++i) {
+      centers_.emplace_back(svc::Point{uniform_(engine_), uniform_(engine_)});
+    }
+  }
+
+  svc::Point position() noexcept {
+    if (distribution_ == Distribution::Clustered) {
+      std::uniform_int_distribution<size_t> cluster{0, centers_.size() - 1};
+      std::normal_distribution<float>       offset{0, ITEMS_SPACING * 5};
+
+      svc::Point center = centers_[cluster(engine_)];
+      return {center.x() + offset(engine_), center.y() + offset(engine_)};
+    }
+
+    return {uniform_(engine_), uniform_(engine_)};
+  }
+
+  /**\brief for skewed distribution sizes have pareto distribution: most of
+   * Items are small, but some of them covers big part of the Scene
+   */
+  float size() noexcept {
+    if (distribution_ == Distribution::Skewed) {
+      std::uniform_real_distribution<float> unit{0.001, 1};
+
+      float size = ITEM_SIZE / std::pow(unit(engine_), 1 / 1.2f);
+      return std::min(size, side_ / 4);
+    }
+
+    return ITEM_SIZE;
+  }
+
+private:
+  Distribution                          distribution_;
+  float                                 side_;
+  std::mt19937                          engine_;
+  std::uniform_real_distribution<float> uniform_;
+  std::vector<svc::Point>               centers_;
+};
+
+static void benchCase(bench::Report &report,
+                      Distribution   distribution,
+                      size_t         count,
+                      size_t         queries) {
+  using Params = std::vector<std::pair<std::string, std::string>>;
+  Params params{{"distribution", toString(distribution)}};
+
+  Generator generator{distribution, count};
+
+  std::vector<svc::ItemPtr> items;
+  items.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    svc::ItemPtr item = std::make_shared<BenchItem>(generator.size());
+    item->setScenePos(generator.position());
+    items.emplace_back(std::move(item));
+  }
+
+  svc::ScenePtr scene = std::make_shared<svc::Scene>();
+
+  { // append
+    bench::Result result{"appendItem", params, {}, {{"items", count}}};
+    result.samples.reserve(count);
+    for (svc::ItemPtr &item : items) {
+      bench::measure(result.samples, [&scene, &item]() {
+        scene->appendItem(item);
+      });
+    }
+    report.append(std::move(result));
+  }
+
+  { // update, setScenePos calls Scene::updateItemPosition
+    bench::Result result{
+        "updateItemPosition", params, {}, {{"items", count}}};
+    result.samples.reserve(count);
+    for (svc::ItemPtr &item : items) {
+      svc::Point pos = generator.position();
+      bench::measure(result.samples, [&item, pos]() {
+        item->setScenePos(pos);
+      });
+    }
+    report.append(std::move(result));
+  }
+
+  svc::ItemBuffer buffer;
+
+  { // point query
+    bench::Result result{"query(Point)", params, {}, {{"items", count}}};
+    result.samples.reserve(queries);
+    size_t found = 0;
+    for (size_t i = 0; i < queries; ++i) {
+      svc::Point pos = generator.position();
+      bench::measure(result.samples, [&scene, &buffer, pos]() {
+        scene->query(pos, buffer);
+      });
+      found += buffer.size();
+    }
+    result.counters.emplace_back("items_per_query", double(found) / queries);
+    report.append(std::move(result));
+  }
+
+  { // box query
+    bench::Result result{"query(Box)", params, {}, {{"items", count}}};
+    result.samples.reserve(queries);
+    size_t found = 0;
+    for (size_t i = 0; i < queries; ++i) {
+      svc::Point minCorner = generator.position();
+      svc::Box   box{minCorner,
+                   {minCorner.x() + VIEW_SIZE, minCorner.y() + VIEW_SIZE}};
+      bench::measure(result.samples, [&scene, &buffer, &box]() {
+        scene->query(box, buffer);
+      });
+      found += buffer.size();
+    }
+    result.counters.emplace_back("items_per_query", double(found) / queries);
+    report.append(std::move(result));
+  }
+
+  { // ring query
+    std::uniform_real_distribution<float> angle{0, 2 * M_PI};
+    std::mt19937                          engine{count};
+
+    bench::Result result{"query(Ring)", params, {}, {{"items", count}}};
+    result.samples.reserve(queries);
+    size_t found = 0;
+    for (size_t i = 0; i < queries; ++i) {
+      svc::Ring ring = svc::Rect{
+          generator.position(), {VIEW_SIZE, VIEW_SIZE}, angle(engine)};
+      bench::measure(result.samples, [&scene, &buffer, &ring]() {
+        scene->query(ring, buffer);
+      });
+      found += buffer.size();
+    }
+    result.counters.emplace_back("items_per_query", double(found) / queries);
+    report.append(std::move(result));
+  }
+
+  { // accept
+    View view;
+    view.setScene(scene);
+
+    bench::Result result{"accept", params, {}, {{"items", count}}};
+    result.samples.reserve(queries);
+    CountVisitor visitor;
+    for (size_t i = 0; i < queries; ++i) {
+      view.setSceneRect(
+          svc::Rect{generator.position(), view.size(), 0});
+      bench::measure(result.samples, [&view, &visitor]() {
+        view.accept(&visitor);
+      });
+    }
+    result.counters.emplace_back("items_per_query",
+                                 double(visitor.count_) / queries);
+    report.append(std::move(result));
+  }
+
+  { // remove
+    std::shuffle(items.begin(), items.end(), std::mt19937{count});
+
+    bench::Result result{"removeItem", params, {}, {{"items", count}}};
+    result.samples.reserve(count);
+    for (svc::ItemPtr &item : items) {
+      bench::measure(result.samples, [&scene, &item]() {
+        scene->removeItem(item.get());
+      });
+    }
+    report.append(std::move(result));
+  }
+}
+
+int main(int argc, char *argv[]) {
+  bench::Arguments args{argc, argv};
+
+  size_t maxItems = args.get("max-items", size_t{DEFAULT_ITEMS_COUNT});
+  size_t queries  = args.get("queries", size_t{DEFAULT_QUERIES});
+  maxItems        = std::min<size_t>(maxItems, MAX_ITEMS_COUNT);
+
+  bench::Report report{"bench_scene"};
+
+  for (size_t count = MIN_ITEMS_COUNT; count <= maxItems; count *= 10) {
+    for (Distribution distribution : {Distribution::Uniform,
+                                      Distribution::Clustered,
+                                      Distribution::Skewed}) {
+      std::cerr << "bench_scene: " << toString(distribution) << " " << count
+                << std::endl;
+
+      benchCase(report, distribution, count, queries);
+    }
+  }
+
+  report.write(std::cout);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,196 @@
+// bench_View.cpp
+/**\file measure frame loop of a View with moving camera
+ *
+ * Usage: bench_view [--items N] [--frames N]
+ *
+ * Every frame the View moves its Scene Rect by scripted camera path (pan,
+ * zoom-out sweep or rotation) and calls accept. For every path frame time,
+ * time of the query and time of visitor dispatch are reported separately.
+ * Results are printed in JSON to stdout
+ */
+
+#include "bench_auxilary.hpp"
+#include "svc/AbstractItem.hpp"
+#include "svc/AbstractView.hpp"
+#include "svc/Scene.hpp"
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <random>
+
+#define DEFAULT_ITEMS  1000000
+#define DEFAULT_FRAMES 300
+
+/// distance between neighbour Items
+#define ITEMS_SPACING 100
+#define ITEM_SIZE     10
+
+#define VIEW_WIDTH  1920
+#define VIEW_HEIGHT 1080
+
+/// zoom-out sweep increases area of Scene Rect by the factor every frame
+#define ZOOM_FACTOR 1.01f
+
+class BenchItem;
+
+namespace svc {
+class AbstractVisitor {
+public:
+  virtual ~AbstractVisitor()          = default;
+  virtual void visit(BenchItem *item) = 0;
+};
+} // namespace svc
+
+class BenchItem final : public svc::AbstractItem {
+public:
+  svc::Box getBoundingBox() const noexcept override {
+    return {{-ITEM_SIZE / 2, -ITEM_SIZE / 2}, {ITEM_SIZE / 2, ITEM_SIZE / 2}};
+  }
+
+  void accept(svc::AbstractVisitor *visitor) override {
+    visitor->visit(this);
+  }
+};
+
+/**\brief imitates drawing: reads position of every visited Item
+ */
+class DrawVisitor final : public svc::AbstractVisitor {
+public:
+  void visit(BenchItem *item) override {
+    svc::Point pos = item->getScenePos();
+    checksum_ += pos.x() + pos.y();
+    ++count_;
+  }
+
+  float  checksum_ = 0;
+  size_t count_    = 0;
+};
+
+/**\brief headless View, which doesn't render anything
+ */
+class View final : public svc::AbstractView {
+public:
+  svc::Size size() const noexcept override {
+    return {VIEW_WIDTH, VIEW_HEIGHT};
+  }
+};
+
+struct CameraPath {
+  std::string name;
+
+  /// moves the View to next frame
+  std::function<void(View &view, size_t frame)> step;
+};
+
+static void benchPath(bench::Report &                    report,
+                      const std::shared_ptr<svc::Scene> &scene,
+                      const CameraPath &                 path,
+                      size_t                             frames,
+                      float                              side) {
+  using Params   = std::vector<std::pair<std::string, std::string>>;
+  using Counters = std::vector<std::pair<std::string, double>>;
+
+  Params   params{{"path", path.name}};
+  Counters counters{{"items", scene->count()}, {"frames", frames}};
+
+  View view;
+  view.setScene(scene);
+  view.setSceneRect(svc::Rect{
+      {side / 2 - VIEW_WIDTH / 2, side / 2 - VIEW_HEIGHT / 2}, view.size(), 0});
+
+  bench::Result frameResult{"frame", params, {}, counters};
+  bench::Result queryResult{"frame.query", params, {}, counters};
+  bench::Result dispatchResult{"frame.dispatch", params, {}, counters};
+  frameResult.samples.reserve(frames);
+  queryResult.samples.reserve(frames);
+  dispatchResult.samples.reserve(frames);
+
+  DrawVisitor     visitor;
+  svc::ItemBuffer buffer;
+  size_t          maxVisited = 0;
+  for (size_t frame = 0; frame < frames; ++frame) {
+    path.step(view, frame);
+
+    size_t visitedBefore = visitor.count_;
+    bench::measure(frameResult.samples, [&view, &visitor]() {
+      view.accept(&visitor);
+    });
+    maxVisited = std::max(maxVisited, visitor.count_ - visitedBefore);
+
+    // XXX accept doesn't provide time of its parts, so same frame is repeated
+    // by parts
+    svc::Rect sceneRect = view.getSceneRect();
+    bench::measure(queryResult.samples, [&scene, &buffer, &sceneRect]() {
+      scene->query(sceneRect, buffer);
+    });
+
+    DrawVisitor dispatchVisitor;
+    bench::measure(dispatchResult.samples, [&buffer, &dispatchVisitor]() {
+      for (svc::AbstractItem *item : buffer) {
+        item->accept(&dispatchVisitor);
+      }
+    });
+  }
+
+  frameResult.counters.emplace_back("items_per_frame",
+                                    double(visitor.count_) / frames);
+  frameResult.counters.emplace_back("max_items_per_frame", maxVisited);
+
+  report.append(std::move(frameResult));
+  report.append(std::move(queryResult));
+  report.append(std::move(dispatchResult));
+}
+
+int main(int argc, char *argv[]) {
+  bench::Arguments args{argc, argv};
+
+  size_t items  = args.get("items", size_t{DEFAULT_ITEMS});
+  size_t frames = args.get("frames", size_t{DEFAULT_FRAMES});
+
+  float side = std::sqrt(float(items)) * ITEMS_SPACING;
+
+  std::cerr << "bench_view: fill Scene by " << items << " Items" << std::endl;
+
+  std::shared_ptr<svc::Scene> scene = std::make_shared<svc::Scene>();
+  {
+    std::mt19937                          engine{42};
+    std::uniform_real_distribution<float> uniform{0, side};
+    for (size_t i = 0; i < items; ++i) {
+      svc::ItemPtr item = std::make_shared<BenchItem>();
+      item->setScenePos(svc::Point{uniform(engine), uniform(engine)});
+      scene->appendItem(item);
+    }
+  }
+
+  svc::Point viewCenter{VIEW_WIDTH / 2, VIEW_HEIGHT / 2};
+
+  // XXX pan path starts at center of the Scene and stays inside the Scene
+  float panStep = side / 2 / frames;
+
+  std::vector<CameraPath> paths{
+      {"pan",
+       [panStep](View &view, [[maybe_unused]] size_t frame) {
+         view.moveSceneRect(svc::Point{panStep, panStep / 2});
+       }},
+      {"zoom-out",
+       [viewCenter](View &view, [[maybe_unused]] size_t frame) {
+         view.scaleSceneRect({ZOOM_FACTOR, ZOOM_FACTOR}, viewCenter);
+       }},
+      {"rotate",
+       [viewCenter, frames](View &view, [[maybe_unused]] size_t frame) {
+         view.rotateSceneRect(2 * M_PI / frames, viewCenter);
+       }},
+  };
+
+  bench::Report report{"bench_view"};
+
+  for (const CameraPath &path : paths) {
+    std::cerr << "bench_view: " << path.name << std::endl;
+
+    benchPath(report, scene, path, frames, side);
+  }
+
+  report.write(std::cout);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,226 @@
+// bench_auxilary.cpp
+
+#include "bench_auxilary.hpp"
+#include "logs.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+#include <stdexcept>
+#include <sys/resource.h>
+
+static std::atomic<size_t> allocationsCounter{0};
+
+[[noreturn]] static void badAlloc() {
+#ifdef __cpp_exceptions
+  throw std::bad_alloc{};
+#else
+  std::abort();
+#endif
+}
+
+void *operator new(size_t size) {
+  allocationsCounter.fetch_add(1, std::memory_order_relaxed);
+
+  if (void *ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  badAlloc();
+}
+
+void *operator new[](size_t size) {
+  return ::operator new(size);
+}
+
+void *operator new(size_t size, std::align_val_t alignment) {
+  allocationsCounter.fetch_add(1, std::memory_order_relaxed);
+
+  // XXX aligned_alloc requires size multiple of alignment
+  size_t align = static_cast<size_t>(alignment);
+  size         = (size + align - 1) / align * align;
+  if (void *ptr = std::aligned_alloc(align, size == 0 ? align : size)) {
+    return ptr;
+  }
+  badAlloc();
+}
+
+void *operator new[](size_t size, std::align_val_t alignment) {
+  return ::operator new(size, alignment);
+}
+
+void operator delete(void *ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+namespace bench {
+size_t allocations() noexcept {
+  return allocationsCounter.load(std::memory_order_relaxed);
+}
+
+void Samples::reserve(size_t n) {
+  nanoseconds_.reserve(n);
+}
+
+void Samples::append(Clock::duration duration, size_t allocations) {
+  nanoseconds_.emplace_back(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+  allocations_ += allocations;
+  sorted_       = false;
+}
+
+size_t Samples::count() const noexcept {
+  return nanoseconds_.size();
+}
+
+double Samples::allocationsPerOperation() const noexcept {
+  if (nanoseconds_.empty()) {
+    return 0;
+  }
+  return double(allocations_) / nanoseconds_.size();
+}
+
+double Samples::total() const noexcept {
+  int64_t sum = 0;
+  for (int64_t val : nanoseconds_) {
+    sum += val;
+  }
+  return double(sum) / 1e9;
+}
+
+double Samples::percentile(double q) {
+  if (nanoseconds_.empty()) {
+    return 0;
+  }
+
+  if (sorted_ == false) {
+    std::sort(nanoseconds_.begin(), nanoseconds_.end());
+    sorted_ = true;
+  }
+
+  // nearest-rank method
+  size_t rank = size_t(std::ceil(q * nanoseconds_.size()));
+  rank        = std::clamp<size_t>(rank, 1, nanoseconds_.size());
+  return double(nanoseconds_[rank - 1]);
+}
+
+void Samples::clear() noexcept {
+  nanoseconds_.clear();
+  allocations_ = 0;
+  sorted_      = true;
+}
+
+long peakRss() noexcept {
+  rusage usage{};
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+
+  // XXX on linux ru_maxrss is in kilobytes
+  return usage.ru_maxrss;
+}
+
+Report::Report(std::string benchName)
+    : benchName_{std::move(benchName)} {
+}
+
+void Report::append(Result result) {
+  entries_.emplace_back(Entry{std::move(result), peakRss()});
+}
+
+void Report::write(std::ostream &out) {
+  out << std::fixed << std::setprecision(2);
+
+  out << "{\n";
+  out << "  \"benchmark\": \"" << benchName_ << "\",\n";
+  out << "  \"results\": [";
+
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    Result &result = entries_[i].result;
+
+    size_t count      = result.samples.count();
+    double total      = result.samples.total();
+    double throughput = total > 0 ? count / total : 0;
+
+    out << (i == 0 ? "\n" : ",\n");
+    out << "    {";
+    out << "\"operation\": \"" << result.operation << "\"";
+    for (const auto &[name, value] : result.params) {
+      out << ", \"" << name << "\": \"" << value << "\"";
+    }
+    out << ", \"ops\": " << count;
+    out << ", \"throughput\": " << throughput;
+    out << ", \"p50_ns\": " << result.samples.percentile(0.5);
+    out << ", \"p99_ns\": " << result.samples.percentile(0.99);
+    out << ", \"allocs_per_op\": " << result.samples.allocationsPerOperation();
+    for (const auto &[name, value] : result.counters) {
+      out << ", \"" << name << "\": " << value;
+    }
+    out << ", \"peak_rss_kb\": " << entries_[i].peakRss;
+    out << "}";
+  }
+
+  out << "\n  ]\n";
+  out << "}\n";
+}
+
+Arguments::Arguments(int argc, char *argv[]) {
+  for (int i = 1; i < argc; ++i) {
+    std::string name = argv[i];
+    if (name.size() < 3 || name.compare(0, 2, "--") != 0 || i + 1 == argc) {
+      LOG_THROW(std::invalid_argument, "invalid argument: %1%", name);
+    }
+
+    args_.emplace_back(name.substr(2), argv[++i]);
+  }
+}
+
+std::string Arguments::get(const std::string &name,
+                           const std::string &defaultValue) const {
+  auto found =
+      std::find_if(args_.begin(), args_.end(), [&name](const auto &arg) {
+        return arg.first == name;
+      });
+  if (found != args_.end()) {
+    return found->second;
+  }
+  return defaultValue;
+}
+
+size_t Arguments::get(const std::string &name, size_t defaultValue) const {
+  std::string value = this->get(name, std::string{});
+  if (value.empty()) {
+    return defaultValue;
+  }
+  return std::stoull(value);
+}
+} // namespace bench
@@ -0,0 +1,125 @@
+// bench_auxilary.hpp
+// contains utils for benchmarks
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bench {
+using Clock = std::chrono::steady_clock;
+
+/**\return count of calls of global operator new from start of the program
+ *
+ * \note global operator new and delete are replaced in bench_auxilary.cpp, so
+ * every benchmark counts allocations
+ */
+size_t allocations() noexcept;
+
+/**\brief latencies and count of allocations of single operations
+ */
+class Samples {
+public:
+  void reserve(size_t n);
+
+  void append(Clock::duration duration, size_t allocations = 0);
+
+  size_t count() const noexcept;
+
+  /**\return average count of allocations per operation
+   */
+  double allocationsPerOperation() const noexcept;
+
+  /**\return sum of all latencies in seconds
+   */
+  double total() const noexcept;
+
+  /**\param q in range [0, 1]
+   *
+   * \return latency in nanoseconds
+   */
+  double percentile(double q);
+
+  void clear() noexcept;
+
+private:
+  std::vector<int64_t> nanoseconds_;
+  size_t               allocations_ = 0;
+  bool                 sorted_      = true;
+};
+
+/**\brief measure time and count of allocations of the functor call and
+ * append them to samples
+ */
+template <typename Functor>
+inline void measure(Samples &samples, Functor &&functor) {
+  size_t            allocs = allocations();
+  Clock::time_point start  = Clock::now();
+  functor();
+  Clock::duration duration = Clock::now() - start;
+  samples.append(duration, allocations() - allocs);
+}
+
+/**\return peak resident set size of the process in kilobytes
+ */
+long peakRss() noexcept;
+
+/**\brief one measured operation
+ */
+struct Result {
+  std::string operation;
+
+  /// parameters of the case: distribution, count of items, etc
+  std::vector<std::pair<std::string, std::string>> params;
+
+  Samples samples;
+
+  /// additional counters of the case: size of results, visited items, etc
+  std::vector<std::pair<std::string, double>> counters;
+};
+
+/**\brief collect results of benchmark and print them as JSON
+ *
+ * Every result contains throughput (operations per second), p50 and p99
+ * latencies (in nanoseconds), allocations per operation and peak RSS (in
+ * kilobytes) at the moment of appending the result
+ */
+class Report {
+public:
+  explicit Report(std::string benchName);
+
+  void append(Result result);
+
+  void write(std::ostream &out);
+
+private:
+  struct Entry {
+    Result result;
+    long   peakRss;
+  };
+
+  std::string        benchName_;
+  std::vector<Entry> entries_;
+};
+
+/**\brief simple parser for arguments in format `--name value`
+ */
+class Arguments {
+public:
+  Arguments(int argc, char *argv[]);
+
+  /**\return value of the argument or defaultValue if the argument is not set
+   */
+  std::string get(const std::string &name,
+                  const std::string &defaultValue) const;
+
+  size_t get(const std::string &name, size_t defaultValue) const;
+
+private:
+  std::vector<std::pair<std::string, std::string>> args_;
+};
+} // namespace bench
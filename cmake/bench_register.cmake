@@ -0,0 +1,8 @@
+macro(bench_register BENCH_NAME BENCH_FILE)
+  add_executable(${BENCH_NAME} ${BENCH_FILE} bench/bench_auxilary.cpp)
+  target_compile_features(${BENCH_NAME} PRIVATE cxx_std_17)
+  target_include_directories(${BENCH_NAME} PRIVATE bench)
+  target_link_libraries(${BENCH_NAME} PRIVATE
+    ${PROJECT_NAME}
+    )
+endmacro()
@@ -31,6 +31,10 @@ set(CMAKE_ARCHIVE_OUTPUT_DIRECTORY "${CMAKE_CURRENT_BINARY_DIR}/lib")
 option(leak_check "set leak_check" 0)
 option(profiling "set profiling" 0)
 option(thread_check "set thread_check" 0)
+option(benchmarks "build benchmarks" 0)
+option(scene_stats "collect statistic of Scene operations" 0)
+option(tracing "collect trace spans" 0)
+option(no_exceptions "build without exceptions (tests are not built)" 0)
 
 if(${CMAKE_BUILD_TYPE} STREQUAL Debug AND leak_check)
   set(CMAKE_CXX_FLAGS_DEBUG "${CMAKE_CXX_FLAGS_DEBUG} -fsanitize=address -fno-omit-frame-pointer")
@@ -62,3 +66,7 @@ message(STATUS "build shared     " ${BUILD_SHARED_LIBS})
 message(STATUS "leak   sanitizer " ${leak_check})
 message(STATUS "thread sanitizer " ${thread_check})
 message(STATUS "profiling        " ${profiling})
+message(STATUS "benchmarks       " ${benchmarks})
+message(STATUS "scene statistic  " ${scene_stats})
+message(STATUS "tracing          " ${tracing})
+message(STATUS "no exceptions    " ${no_exceptions})
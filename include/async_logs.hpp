@@ -0,0 +1,372 @@
+// async_logs.hpp
+/**\file
+ * Asynchronous logger: calling thread only pushes arguments of a record to
+ * lock-free ring buffer, and formatting (by STANDARD_LOG_FORMAT) and writing
+ * are done by background thread.
+ *
+ * For using the logger you need set it to LoggerFactory:
+ *
+ * ```cpp
+ * logs::AsyncLogger logger{std::cerr};
+ * logs::LoggerFactory::set(&logger);
+ * ...
+ * logs::LoggerFactory::set(nullptr);
+ * ```
+ *
+ * \note usual macroses combine user message by boost::format on calling
+ * thread before calling a logger, so only metadata of the record is formatted
+ * by the background thread. `LOG_ASYNC_C` copies arguments to the record and
+ * user message is formatted by the background thread too
+ *
+ * \see logs.hpp
+ */
+
+#pragma once
+
+#include "logs.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <variant>
+
+#define ASYNC_LOG_DEFAULT_CAPACITY   1024
+#define ASYNC_LOG_DEFAULT_BATCH_SIZE 64
+
+/// max time of sleeping of background thread if producers don't wake it
+#define ASYNC_LOG_IDLE_TIMEOUT std::chrono::milliseconds{10}
+
+namespace logs {
+/**\brief what should logger do with new record if its buffer is full
+ */
+enum class OverflowPolicy {
+  /// the record will be lost, count of lost records available by `dropped`
+  Drop,
+  /// calling thread will wait until background thread writes some records
+  Block,
+};
+
+/**\brief logger, which writes records by background thread
+ *
+ * Records are pushed to bounded multi-producer ring buffer (algorithm of
+ * Dmitry Vyukov), so calling threads never lock mutex in usual case. Background
+ * thread takes records by batches, formats them and writes every batch to the
+ * output by one call.
+ *
+ * \note Error, Throw and Failure records are never dropped: they are written
+ * synchronously by calling thread after flushing of all previous records.
+ * After writing of Failure record the program is terminated
+ */
+class AsyncLogger final : public BasicLogger {
+public:
+  /**\param out stream for writing records, must live longer then the logger
+   * \param capacity max count of records in the buffer, will be rounded up to
+   * power of two
+   * \param batchSize max count of records written by one call
+   */
+  explicit AsyncLogger(std::ostream & out,
+                       size_t         capacity  = ASYNC_LOG_DEFAULT_CAPACITY,
+                       OverflowPolicy policy    = OverflowPolicy::Drop,
+                       size_t         batchSize = ASYNC_LOG_DEFAULT_BATCH_SIZE)
+      : out_{out}
+      , policy_{policy}
+      , batchSize_{batchSize != 0 ? batchSize : 1}
+      , mask_{roundCapacity(capacity) - 1}
+      , cells_{new Cell[mask_ + 1]}
+      , enqueuePos_{0}
+      , dequeuePos_{0}
+      , pushed_{0}
+      , written_{0}
+      , dropped_{0}
+      , stop_{false}
+      , sleeping_{false} {
+    for (size_t i = 0; i <= mask_; ++i) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    thread_ = std::thread{&AsyncLogger::run, this};
+  }
+
+  /**\brief writes all records, which are in the buffer, and stops background
+   * thread
+   *
+   * \warning the logger must be unset from LoggerFactory before destruction
+   */
+  ~AsyncLogger() noexcept {
+    stop_.store(true, std::memory_order_release);
+    this->wakeUp();
+    thread_.join();
+  }
+
+  void log(Severity                                           severity,
+           std::string_view                                   fileName,
+           int                                                lineNumber,
+           std::string_view                                   functionName,
+           std::chrono::time_point<std::chrono::system_clock> timePoint,
+           std::thread::id                                    threadId,
+           boost::format message) noexcept override {
+    this->push(Record{severity,
+                      fileName,
+                      lineNumber,
+                      functionName,
+                      timePoint,
+                      threadId,
+                      std::move(message)});
+  }
+
+  /**\brief same as log, but user message is formatted by background thread
+   */
+  void
+  logDeferred(Severity                                           severity,
+              std::string_view                                   fileName,
+              int                                                lineNumber,
+              std::string_view                                   functionName,
+              std::chrono::time_point<std::chrono::system_clock> timePoint,
+              std::thread::id                                    threadId,
+              DeferredMessage message) noexcept override {
+    this->push(Record{severity,
+                      fileName,
+                      lineNumber,
+                      functionName,
+                      timePoint,
+                      threadId,
+                      std::move(message)});
+  }
+
+  /**\brief wait until all records pushed before the call are written to
+   * output
+   */
+  void flush() noexcept {
+    size_t target = pushed_.load(std::memory_order_acquire);
+
+    std::unique_lock<std::mutex> lock{mutex_};
+    while (written_.load(std::memory_order_acquire) < target) {
+      wake_.notify_one();
+      flushed_.wait_for(lock, ASYNC_LOG_IDLE_TIMEOUT);
+    }
+  }
+
+  /**\return count of records lost because of full buffer
+   */
+  size_t dropped() const noexcept {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+private:
+  AsyncLogger(const AsyncLogger &) = delete;
+  AsyncLogger(AsyncLogger &&)      = delete;
+
+  struct Record {
+    Severity                                           severity;
+    std::string_view                                   fileName;
+    int                                                lineNumber;
+    std::string_view                                   functionName;
+    std::chrono::time_point<std::chrono::system_clock> timePoint;
+    std::thread::id                                    threadId;
+
+    /// deferred message is formatted by background thread
+    std::variant<boost::format, DeferredMessage> message;
+  };
+
+  struct Cell {
+    std::atomic<size_t>   sequence;
+    std::optional<Record> record;
+  };
+
+  static size_t roundCapacity(size_t capacity) noexcept {
+    size_t retval = 2;
+    while (retval < capacity) {
+      retval <<= 1;
+    }
+    return retval;
+  }
+
+  /**\brief push the record to the buffer by the overflow policy. Important
+   * records are written synchronously
+   *
+   * \note can be called by any thread
+   */
+  void push(Record record) noexcept {
+    if (getLevel(record.severity) >= getLevel(Severity::Error)) {
+      this->flush();
+
+      std::string line = format(record);
+      {
+        std::lock_guard<std::mutex> lock{writeMutex_};
+        out_.write(line.data(), line.size());
+        out_.flush();
+      }
+
+      if (Severity::Failure == record.severity) {
+        exit(EXIT_FAILURE);
+      }
+      return;
+    }
+
+    bool pushed = this->tryPush(record);
+    if (pushed == false && policy_ == OverflowPolicy::Block) {
+      // XXX background thread notifies about every written batch under the
+      // mutex, so the notification can not be lost between the check and
+      // waiting
+      std::unique_lock<std::mutex> lock{mutex_};
+      while ((pushed = this->tryPush(record)) == false) {
+        wake_.notify_one();
+        flushed_.wait_for(lock, ASYNC_LOG_IDLE_TIMEOUT);
+      }
+    }
+
+    if (pushed == false) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+    } else if (sleeping_.load(std::memory_order_relaxed)) {
+      this->wakeUp();
+    }
+  }
+
+  /**\return the record formatted by STANDARD_LOG_FORMAT with end of line
+   */
+  static std::string format(Record &record) noexcept {
+    boost::format message =
+        std::holds_alternative<DeferredMessage>(record.message)
+            ? std::get<DeferredMessage>(record.message).format()
+            : std::move(std::get<boost::format>(record.message));
+
+    std::string retval = getRecord(record.severity,
+                                   record.fileName,
+                                   record.lineNumber,
+                                   record.functionName,
+                                   record.timePoint,
+                                   record.threadId,
+                                   std::move(message));
+    retval += '\n';
+    return retval;
+  }
+
+  /**\note can be called by any thread
+   *
+   * \return false if the buffer is full
+   */
+  bool tryPush(Record &record) noexcept {
+    Cell * cell = nullptr;
+    size_t pos  = enqueuePos_.load(std::memory_order_relaxed);
+    for (;;) {
+      cell          = &cells_[pos & mask_];
+      size_t   seq  = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = intptr_t(seq) - intptr_t(pos);
+      if (diff == 0) {
+        if (enqueuePos_.compare_exchange_weak(pos,
+                                              pos + 1,
+                                              std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueuePos_.load(std::memory_order_relaxed);
+      }
+    }
+
+    cell->record.emplace(std::move(record));
+    cell->sequence.store(pos + 1, std::memory_order_release);
+
+    pushed_.fetch_add(1, std::memory_order_release);
+    return true;
+  }
+
+  /**\note can be called only by background thread
+   *
+   * \return false if the buffer is empty
+   */
+  bool tryPop(Record &record) noexcept {
+    Cell &   cell = cells_[dequeuePos_ & mask_];
+    size_t   seq  = cell.sequence.load(std::memory_order_acquire);
+    intptr_t diff = intptr_t(seq) - intptr_t(dequeuePos_ + 1);
+    if (diff < 0) {
+      return false;
+    }
+
+    record = std::move(*cell.record);
+    cell.record.reset();
+    cell.sequence.store(dequeuePos_ + mask_ + 1, std::memory_order_release);
+    ++dequeuePos_;
+    return true;
+  }
+
+  void wakeUp() noexcept {
+    std::lock_guard<std::mutex> lock{mutex_};
+    wake_.notify_one();
+  }
+
+  /**\brief body of background thread
+   */
+  void run() noexcept {
+    std::string batch;
+    Record      record{Severity::Info, {}, 0, {}, {}, {}, DeferredMessage{}};
+    for (;;) {
+      // XXX stop flag must be read before draining, otherwise records pushed
+      // between draining and the check will be lost
+      bool stop = stop_.load(std::memory_order_acquire);
+
+      size_t count = 0;
+      batch.clear();
+      while (count < batchSize_) {
+        if (this->tryPop(record) == false) {
+          break;
+        }
+
+        batch += format(record);
+        ++count;
+      }
+
+      if (count != 0) {
+        {
+          std::lock_guard<std::mutex> lock{writeMutex_};
+          out_.write(batch.data(), batch.size());
+          out_.flush();
+        }
+
+        written_.fetch_add(count, std::memory_order_release);
+        std::lock_guard<std::mutex> lock{mutex_};
+        flushed_.notify_all();
+        continue;
+      }
+
+      if (stop) {
+        break;
+      }
+
+      std::unique_lock<std::mutex> lock{mutex_};
+      sleeping_.store(true, std::memory_order_relaxed);
+      wake_.wait_for(lock, ASYNC_LOG_IDLE_TIMEOUT);
+      sleeping_.store(false, std::memory_order_relaxed);
+    }
+  }
+
+private:
+  std::ostream &          out_;
+  const OverflowPolicy    policy_;
+  const size_t            batchSize_;
+  const size_t            mask_;
+  std::unique_ptr<Cell[]> cells_;
+
+  // XXX positions are placed in different cache lines, because producers and
+  // consumer change them concurrently
+  alignas(64) std::atomic<size_t> enqueuePos_;
+  alignas(64) size_t dequeuePos_;
+
+  std::atomic<size_t> pushed_;
+  std::atomic<size_t> written_;
+  std::atomic<size_t> dropped_;
+  std::atomic<bool>   stop_;
+  std::atomic<bool>   sleeping_;
+
+  std::mutex              mutex_;
+  /// synchronizes writing of background thread and synchronous records
+  std::mutex              writeMutex_;
+  std::condition_variable wake_;
+  std::condition_variable flushed_;
+  std::thread             thread_;
+};
+} // namespace logs
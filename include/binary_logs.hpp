@@ -0,0 +1,640 @@
+// binary_logs.hpp
+/**\file
+ * Binary logging for always-on logs. Record of the binary log contains only
+ * id of format string of the call site, time, thread id and raw bytes of
+ * arguments. Records are appended to preallocated memory-mapped file, so
+ * writing of a record is only reserving of space by one atomic operation and
+ * copying of arguments. Text of records is produced later by `log_decoder`
+ * tool in STANDARD_LOG_FORMAT.
+ *
+ * ```cpp
+ * logs::BinaryLogger logger{"app.blog", 64 << 20};
+ * logs::BinaryLoggerFactory::set(&logger);
+ *
+ * LOG_BINARY(logs::Severity::Info, "frame %1% takes %2%ms", frame, ms);
+ *
+ * logs::BinaryLoggerFactory::set(nullptr);
+ * ```
+ *
+ * Format string, file name and function name of every call site are written
+ * to the file only once: by first call of the call site or by setting of
+ * logger (for call sites called before).
+ *
+ * Arguments can be only arithmetic types and strings (`const char *`,
+ * `std::string`, `std::string_view`).
+ *
+ * If the file is full, then new records are dropped, count of dropped records
+ * is written to header of the file.
+ *
+ * Time of record is read by GET_BINARY_LOG_TIME. Precise system clock costs
+ * about half of time of a record, so if you don't need precise time, then
+ * define `BINARY_LOG_COARSE_TIME` (resolution of the clock is several
+ * milliseconds) or redefine the macro.
+ *
+ * \note works only on POSIX systems
+ *
+ * \see logs.hpp
+ */
+
+#pragma once
+
+#include "logs.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <type_traits>
+#include <unistd.h>
+#include <vector>
+
+#define BINARY_LOG_MAGIC "SVCBLOG1"
+
+// XXX pages of the file are loaded by mapping (if possible), otherwise first
+// records on every page cost page fault
+#ifdef MAP_POPULATE
+#  define BINARY_LOG_MAP_FLAGS MAP_SHARED | MAP_POPULATE
+#else
+#  define BINARY_LOG_MAP_FLAGS MAP_SHARED
+#endif
+
+/**\brief get time of binary record in nanoseconds from epoch of system clock
+ */
+#ifndef GET_BINARY_LOG_TIME
+#  if defined(BINARY_LOG_COARSE_TIME) && defined(CLOCK_REALTIME_COARSE)
+#    define GET_BINARY_LOG_TIME() logs::binary::coarseTime()
+#  else
+#    define GET_BINARY_LOG_TIME()                                              \
+      std::chrono::duration_cast<std::chrono::nanoseconds>(                    \
+          std::chrono::system_clock::now().time_since_epoch())                 \
+          .count()
+#  endif
+#endif
+
+namespace logs {
+namespace binary {
+enum class ArgType : uint8_t {
+  /// records are padded by zeros, so zero type means end of arguments
+  End,
+  Int,
+  UInt,
+  Double,
+  Bool,
+  Char,
+  String,
+};
+
+struct FileHeader {
+  char magic[8];
+
+  /// count of used bytes, include the header
+  uint64_t size;
+  uint64_t dropped;
+};
+
+/**\brief header of every record. Records with formatId 0 contain definition of
+ * format: id, severity, line number, file name, function name and format string
+ */
+struct RecordHeader {
+  /// size of whole record, 0 if record was not finished
+  uint32_t size;
+  uint32_t formatId;
+
+  /// nanoseconds from epoch of system clock
+  int64_t  time;
+  uint64_t threadId;
+};
+
+/// every record is aligned, so size of record can be written atomically
+constexpr size_t RecordAlignment = 8;
+
+template <typename T>
+struct Unsupported : std::false_type {};
+
+template <typename T>
+constexpr size_t encodedSize(const T &arg) noexcept {
+  if constexpr (std::is_same_v<T, bool> || std::is_same_v<T, char>) {
+    return 1 + 1;
+  } else if constexpr (std::is_arithmetic_v<T>) {
+    return 1 + 8;
+  } else if constexpr (std::is_convertible_v<const T &, std::string_view>) {
+    return 1 + sizeof(uint32_t) + std::string_view{arg}.size();
+  } else {
+    static_assert(Unsupported<T>::value,
+                  "binary log supports only arithmetic types and strings");
+    return 0;
+  }
+}
+
+inline void encodeRaw(char *&out, const void *data, size_t size) noexcept {
+  std::memcpy(out, data, size);
+  out += size;
+}
+
+template <typename T>
+void encode(char *&out, const T &arg) noexcept {
+  if constexpr (std::is_same_v<T, bool>) {
+    *out++ = char(ArgType::Bool);
+    *out++ = char(arg);
+  } else if constexpr (std::is_same_v<T, char>) {
+    *out++ = char(ArgType::Char);
+    *out++ = arg;
+  } else if constexpr (std::is_floating_point_v<T>) {
+    double value = arg;
+    *out++       = char(ArgType::Double);
+    encodeRaw(out, &value, sizeof(value));
+  } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+    int64_t value = arg;
+    *out++        = char(ArgType::Int);
+    encodeRaw(out, &value, sizeof(value));
+  } else if constexpr (std::is_integral_v<T>) {
+    uint64_t value = arg;
+    *out++         = char(ArgType::UInt);
+    encodeRaw(out, &value, sizeof(value));
+  } else {
+    std::string_view str{arg};
+    uint32_t         size = str.size();
+    *out++                = char(ArgType::String);
+    encodeRaw(out, &size, sizeof(size));
+    encodeRaw(out, str.data(), str.size());
+  }
+}
+
+constexpr size_t alignSize(size_t size) noexcept {
+  return (size + RecordAlignment - 1) & ~(RecordAlignment - 1);
+}
+
+#ifdef CLOCK_REALTIME_COARSE
+/**\return nanoseconds from epoch of system clock by coarse clock
+ */
+inline int64_t coarseTime() noexcept {
+  timespec time;
+  ::clock_gettime(CLOCK_REALTIME_COARSE, &time);
+  return int64_t(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+#endif
+} // namespace binary
+
+/**\brief static information about call site
+ */
+struct FormatInfo {
+  Severity         severity;
+  std::string_view fileName;
+  int              lineNumber;
+  std::string_view functionName;
+  std::string_view format;
+};
+
+/**\brief writes records to memory-mapped file
+ */
+class BinaryLogger final {
+public:
+  /**\param capacity size of the file in bytes. The file is truncated to really
+   * used size by destructor
+   *
+   * \throw exception if the file can not be created
+   */
+  BinaryLogger(const std::string &fileName, size_t capacity)
+      : fd_{-1}
+      , data_{nullptr}
+      , capacity_{std::max(capacity, sizeof(binary::FileHeader))}
+      , offset_{sizeof(binary::FileHeader)}
+      , dropped_{0} {
+    fd_ = ::open(fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd_ == -1) {
+      LOG_THROW(std::runtime_error, "can not open file %1%", fileName);
+    }
+
+    void *data = MAP_FAILED;
+    if (::ftruncate(fd_, capacity_) == 0) {
+      data = ::mmap(nullptr,
+                    capacity_,
+                    PROT_READ | PROT_WRITE,
+                    BINARY_LOG_MAP_FLAGS,
+                    fd_,
+                    0);
+    }
+    if (data == MAP_FAILED) {
+      ::close(fd_);
+      LOG_THROW(std::runtime_error, "can not map file %1%", fileName);
+    }
+    data_ = static_cast<char *>(data);
+
+    binary::FileHeader header{};
+    std::memcpy(header.magic, BINARY_LOG_MAGIC, sizeof(header.magic));
+    std::memcpy(data_, &header, sizeof(header));
+  }
+
+  /**\brief writes header of the file and truncates the file to used size
+   *
+   * \warning the logger must be unset from BinaryLoggerFactory before
+   * destruction
+   */
+  ~BinaryLogger() noexcept {
+    binary::FileHeader header;
+    std::memcpy(&header, data_, sizeof(header));
+    header.size    = this->size();
+    header.dropped = this->dropped();
+    std::memcpy(data_, &header, sizeof(header));
+
+    ::munmap(data_, capacity_);
+    [[maybe_unused]] int ret = ::ftruncate(fd_, header.size);
+    ::close(fd_);
+  }
+
+  template <typename... Args>
+  void write(uint32_t formatId, const Args &... args) noexcept {
+    size_t size = binary::alignSize(sizeof(binary::RecordHeader) +
+                                    (binary::encodedSize(args) + ... + 0));
+    char *record = this->reserve(size);
+    if (record == nullptr) {
+      return;
+    }
+
+    [[maybe_unused]] char *out = record + sizeof(binary::RecordHeader);
+    (binary::encode(out, args), ...);
+
+    this->commit(record, size, formatId);
+  }
+
+  /**\brief writes definition of format to the log
+   */
+  void writeFormat(uint32_t formatId, const FormatInfo &info) noexcept {
+    this->write(0,
+                uint64_t{formatId},
+                int64_t(info.severity),
+                int64_t{info.lineNumber},
+                info.fileName,
+                info.functionName,
+                info.format);
+  }
+
+  /**\return count of used bytes
+   */
+  size_t size() const noexcept {
+    return std::min(offset_.load(std::memory_order_relaxed), capacity_);
+  }
+
+  /**\return count of records lost because of full file
+   */
+  size_t dropped() const noexcept {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+private:
+  BinaryLogger(const BinaryLogger &) = delete;
+  BinaryLogger(BinaryLogger &&)      = delete;
+
+  char *reserve(size_t size) noexcept {
+    size_t offset = offset_.fetch_add(size, std::memory_order_relaxed);
+    if (offset + size > capacity_) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    return data_ + offset;
+  }
+
+  /**\brief writes header of the record. Size of the record is written last, so
+   * decoder never reads not finished record
+   */
+  static void commit(char *record, size_t size, uint32_t formatId) noexcept {
+    thread_local uint64_t threadId = std::hash<std::thread::id>{}(
+        std::this_thread::get_id());
+
+    binary::RecordHeader header{0, formatId, GET_BINARY_LOG_TIME(), threadId};
+    std::memcpy(record, &header, sizeof(header));
+
+    __atomic_store_n(reinterpret_cast<uint32_t *>(record),
+                     uint32_t(size),
+                     __ATOMIC_RELEASE);
+  }
+
+private:
+  int    fd_;
+  char * data_;
+  size_t capacity_;
+
+  std::atomic<size_t> offset_;
+  std::atomic<size_t> dropped_;
+};
+
+/**\brief contains current BinaryLogger and formats of all call sites
+ */
+class BinaryLoggerFactory final {
+public:
+  /**\return current logger or nullptr if logger was not set
+   */
+  static BinaryLogger *get() noexcept {
+    return current().load(std::memory_order_acquire);
+  }
+
+  /**\brief set logger for all following records. Formats of all call sites,
+   * which were called before, are written to the logger. nullptr disables
+   * binary logging
+   *
+   * \warning must not be called concurrently with logging
+   */
+  static void set(BinaryLogger *logger) noexcept {
+    Formats &formats = getFormats();
+
+    std::lock_guard<std::mutex> lock{formats.mutex};
+    if (logger != nullptr) {
+      for (size_t i = 0; i < formats.infos.size(); ++i) {
+        logger->writeFormat(i + 1, formats.infos[i]);
+      }
+    }
+    current().store(logger, std::memory_order_release);
+  }
+
+  /**\return id of the format, ids start from 1. Format is written to current
+   * logger
+   *
+   * \note called once for every call site
+   */
+  static uint32_t registerFormat(const FormatInfo &info) noexcept {
+    Formats &formats = getFormats();
+
+    std::lock_guard<std::mutex> lock{formats.mutex};
+    formats.infos.emplace_back(info);
+    uint32_t id = formats.infos.size();
+    if (BinaryLogger *logger = current().load(std::memory_order_relaxed)) {
+      logger->writeFormat(id, info);
+    }
+    return id;
+  }
+
+private:
+  struct Formats {
+    std::mutex              mutex;
+    std::vector<FormatInfo> infos;
+  };
+
+  static std::atomic<BinaryLogger *> &current() noexcept {
+    static std::atomic<BinaryLogger *> logger{nullptr};
+    return logger;
+  }
+
+  static Formats &getFormats() noexcept {
+    static Formats formats;
+    return formats;
+  }
+};
+
+/**\brief help function for LOG_BINARY: skips format string
+ */
+template <typename... Args>
+void writeBinary(BinaryLogger &logger,
+                 uint32_t      formatId,
+                 [[maybe_unused]] std::string_view format,
+                 const Args &... args) noexcept {
+  logger.write(formatId, args...);
+}
+
+namespace binary {
+/**\brief reads values from record of binary log
+ */
+class Reader final {
+public:
+  Reader(const char *begin, const char *end) noexcept
+      : cur_{begin}
+      , end_{end} {
+  }
+
+  template <typename T>
+  bool readRaw(T &value) noexcept {
+    if (size_t(end_ - cur_) < sizeof(T)) {
+      return false;
+    }
+    std::memcpy(&value, cur_, sizeof(T));
+    cur_ += sizeof(T);
+    return true;
+  }
+
+  bool readString(std::string_view &str) noexcept {
+    uint32_t size;
+    if (this->readRaw(size) == false || size_t(end_ - cur_) < size) {
+      return false;
+    }
+    str = std::string_view{cur_, size};
+    cur_ += size;
+    return true;
+  }
+
+  /**\brief reads next argument and appends it to the format
+   *
+   * \return false if there is no more arguments
+   */
+  bool readArgument(boost::format &format) noexcept {
+    ArgType type;
+    if (this->readRaw(type) == false) {
+      return false;
+    }
+
+    switch (type) {
+    case ArgType::End:
+      return false;
+    case ArgType::Int:
+      return this->apply<int64_t>(format);
+    case ArgType::UInt:
+      return this->apply<uint64_t>(format);
+    case ArgType::Double:
+      return this->apply<double>(format);
+    case ArgType::Bool:
+      return this->apply<bool>(format);
+    case ArgType::Char:
+      return this->apply<char>(format);
+    case ArgType::String: {
+      std::string_view str;
+      if (this->readString(str) == false) {
+        return false;
+      }
+      format % str;
+      return true;
+    }
+    }
+    return false;
+  }
+
+  /**\brief reads argument of definition of format
+   */
+  template <typename T>
+  bool readDefinition(T &value) noexcept {
+    ArgType type;
+    if (this->readRaw(type) == false) {
+      return false;
+    }
+    if constexpr (std::is_same_v<T, std::string_view>) {
+      return type == ArgType::String && this->readString(value);
+    } else {
+      return this->readRaw(value);
+    }
+  }
+
+private:
+  template <typename T>
+  bool apply(boost::format &format) noexcept {
+    T value;
+    if (this->readRaw(value) == false) {
+      return false;
+    }
+    format % value;
+    return true;
+  }
+
+private:
+  const char *cur_;
+  const char *end_;
+};
+
+/**\brief reads records from content of binary log
+ *
+ * \warning strings of formats point to the content, so the content must live
+ * longer then the decoder
+ */
+class Decoder final {
+public:
+  Decoder(const char *data, size_t size) noexcept
+      : data_{data}
+      , size_{size}
+      , header_{}
+      , invalid_{0} {
+    if (size_ >= sizeof(header_)) {
+      std::memcpy(&header_, data_, sizeof(header_));
+
+      // XXX if the program was not finished correctly, then header doesn't
+      // contain size, so records are read until first not finished record
+      if (header_.size != 0) {
+        size_ = std::min<size_t>(header_.size, size_);
+      }
+    }
+  }
+
+  /**\return false if the content is not binary log
+   */
+  bool isValid() const noexcept {
+    if (size_ < sizeof(header_)) {
+      return false;
+    }
+    return std::memcmp(header_.magic,
+                       BINARY_LOG_MAGIC,
+                       sizeof(header_.magic)) == 0;
+  }
+
+  const FileHeader &getHeader() const noexcept {
+    return header_;
+  }
+
+  /**\brief calls the function for every record (except definitions of
+   * formats) as `function(info, timePoint, threadId, message)`
+   *
+   * \return count of decoded records
+   */
+  template <typename Function>
+  size_t decode(Function &&function) {
+    if (this->isValid() == false) {
+      return 0;
+    }
+
+    size_t count  = 0;
+    size_t offset = sizeof(header_);
+    while (offset + sizeof(RecordHeader) <= size_) {
+      RecordHeader record;
+      std::memcpy(&record, data_ + offset, sizeof(record));
+      if (record.size < sizeof(record) || offset + record.size > size_) {
+        break;
+      }
+
+      Reader reader{data_ + offset + sizeof(record),
+                    data_ + offset + record.size};
+      offset += record.size;
+
+      if (record.formatId == 0) {
+        this->readFormat(reader);
+        continue;
+      }
+
+      auto found = formats_.find(record.formatId);
+      if (found == formats_.end()) {
+        ++invalid_;
+        continue;
+      }
+      const FormatInfo &info = found->second;
+
+      boost::format message = getLogFormat(info.format);
+      while (reader.readArgument(message)) {
+      }
+
+      function(info,
+               std::chrono::time_point<std::chrono::system_clock>{
+                   std::chrono::duration_cast<
+                       std::chrono::system_clock::duration>(
+                       std::chrono::nanoseconds{record.time})},
+               record.threadId,
+               std::move(message));
+      ++count;
+    }
+
+    return count;
+  }
+
+  /**\return count of records, which can not be decoded: invalid definitions
+   * of formats and records with unknown format
+   */
+  size_t invalid() const noexcept {
+    return invalid_;
+  }
+
+private:
+  void readFormat(Reader &reader) {
+    uint64_t   id;
+    int64_t    severity;
+    int64_t    lineNumber;
+    FormatInfo info;
+    if (reader.readDefinition(id) && reader.readDefinition(severity) &&
+        reader.readDefinition(lineNumber) &&
+        reader.readDefinition(info.fileName) &&
+        reader.readDefinition(info.functionName) &&
+        reader.readDefinition(info.format)) {
+      info.severity   = Severity(severity);
+      info.lineNumber = lineNumber;
+      formats_[id]    = info;
+    } else {
+      ++invalid_;
+    }
+  }
+
+private:
+  const char *                   data_;
+  size_t                         size_;
+  FileHeader                     header_;
+  size_t                         invalid_;
+  std::map<uint32_t, FormatInfo> formats_;
+};
+} // namespace binary
+} // namespace logs
+
+// XXX extra argument is needed, because variadic macro requires at least one
+// argument for `...`
+#define LOG_BINARY_FORMAT_IMP(format, ...) format
+#define LOG_BINARY_FORMAT(...)             LOG_BINARY_FORMAT_IMP(__VA_ARGS__, 0)
+
+/**\brief write record to current BinaryLogger. First argument is format string
+ * (must be a string literal), all other arguments are arguments of the format
+ */
+#define LOG_BINARY(severity, ...)                                              \
+  do {                                                                         \
+    if (logs::BinaryLogger *logBinary = logs::BinaryLoggerFactory::get()) {    \
+      static const uint32_t logFormatId =                                      \
+          logs::BinaryLoggerFactory::registerFormat(                           \
+              logs::FormatInfo{severity,                                       \
+                               __FILE__,                                       \
+                               __LINE__,                                       \
+                               __func__,                                       \
+                               LOG_BINARY_FORMAT(__VA_ARGS__)});               \
+      logs::writeBinary(*logBinary, logFormatId, __VA_ARGS__);                 \
+    }                                                                          \
+  } while (false)
@@ -24,6 +24,22 @@
  * \warning Logging macroses produce output only if macro `NDEBUG` not defined,
  * BUT! `LOG_THROW` and `LOG_FAILURE` will work even if `NDEBUG` defined!
  *
+ * Macroses with `_C` suffix (`LOG_INFO_C`, `LOG_DEBUG_C` etc) write records to
+ * named category and work even if `NDEBUG` defined. Every category has its own
+ * threshold of severity, which can be changed at runtime by
+ * `logs::CategoryRegistry` or by environment variable `LOG_LEVELS` (for
+ * example `LOG_LEVELS="scene=debug,view=warning"`, level without name changes
+ * all categories). Threshold is checked before evaluation of arguments and
+ * costs only one relaxed atomic load. By default threshold is `warning` if
+ * `NDEBUG` defined and `debug` otherwise. Records of macroses without suffix
+ * belong to `default` category.
+ *
+ * For hot paths use `LOG_EVERY_N_C` (write every n-th record of the call site)
+ * and `LOG_EVERY_MS_C` (write not more then one record of the call site per
+ * the period). `LOG_ASYNC_C` copies arguments and leaves formatting of user
+ * message to the logger, so with AsyncLogger calling thread doesn't format
+ * anything.
+ *
  * \warning be carefull in using logging in destructors. Logger is a static
  * object, but there is no guarantie that it will not destroy before some other
  * static objects or etc. If you get error like
@@ -33,13 +49,21 @@
 
 #pragma once
 
+#include <atomic>
 #include <boost/format.hpp>
 #include <chrono>
+#include <cstddef>
 #include <cstdlib>
+#include <deque>
 #include <iomanip>
 #include <iostream>
+#include <mutex>
+#include <new>
+#include <string>
 #include <string_view>
 #include <thread>
+#include <tuple>
+#include <type_traits>
 
 #define INFO_SEVERITY    "INF"
 #define DEBUG_SEVERITY   "DBG"
@@ -83,6 +107,11 @@
 #define THREAD_ID      "%7%"
 #define MESSAGE        "%8%"
 
+/// size of arguments of DeferredMessage, which are stored without allocation
+#ifndef LOG_DEFERRED_INLINE_SIZE
+#  define LOG_DEFERRED_INLINE_SIZE 64
+#endif
+
 #ifndef STANDARD_LOG_FORMAT
 /// default logging format
 #  define STANDARD_LOG_FORMAT                                                  \
@@ -142,17 +171,148 @@ boost::format messageHandler(std::string_view messageFormat,
   return doFormat(std::move(format), args...);
 }
 
+/**\brief user message, which is formatted only by request (see `LOG_ASYNC_C`).
+ * Arguments are copied into the message, small sets of arguments are placed
+ * inline, so creation of the message doesn't allocate memory
+ *
+ * \warning pointers (c-strings, string_view) are copied as is, so data pointed
+ * by them must be valid until the message will be formatted. String literals
+ * are safe
+ */
+class DeferredMessage final {
+public:
+  DeferredMessage() noexcept = default;
+
+  template <typename... Args>
+  explicit DeferredMessage(std::string_view messageFormat, Args &&...args) {
+    using HolderType = Holder<std::decay_t<Args>...>;
+
+    if constexpr (sizeof(HolderType) <= sizeof(storage_) &&
+                  alignof(HolderType) <= alignof(std::max_align_t) &&
+                  std::is_nothrow_move_constructible_v<HolderType>) {
+      new (storage_) HolderType{messageFormat, {std::forward<Args>(args)...}};
+      operations_ = &inlineOperations<HolderType>;
+    } else {
+      HolderType *holder =
+          new HolderType{messageFormat, {std::forward<Args>(args)...}};
+      new (storage_) HolderType *{holder};
+      operations_ = &heapOperations<HolderType>;
+    }
+  }
+
+  DeferredMessage(DeferredMessage &&rhs) noexcept
+      : operations_{rhs.operations_} {
+    if (operations_ != nullptr) {
+      operations_->move(storage_, rhs.storage_);
+      rhs.operations_ = nullptr;
+    }
+  }
+
+  DeferredMessage &operator=(DeferredMessage &&rhs) noexcept {
+    if (this != &rhs) {
+      this->reset();
+      if (rhs.operations_ != nullptr) {
+        rhs.operations_->move(storage_, rhs.storage_);
+        operations_     = rhs.operations_;
+        rhs.operations_ = nullptr;
+      }
+    }
+    return *this;
+  }
+
+  ~DeferredMessage() noexcept {
+    this->reset();
+  }
+
+  bool empty() const noexcept {
+    return operations_ == nullptr;
+  }
+
+  /**\return the message formatted by `messageHandler`
+   */
+  boost::format format() const noexcept {
+    if (operations_ == nullptr) {
+      return boost::format{};
+    }
+    return operations_->format(storage_);
+  }
+
+private:
+  DeferredMessage(const DeferredMessage &) = delete;
+  DeferredMessage &operator=(const DeferredMessage &) = delete;
+
+  template <typename... Args>
+  struct Holder {
+    std::string_view    messageFormat;
+    std::tuple<Args...> args;
+
+    boost::format format() const noexcept {
+      return std::apply(
+          [this](const Args &...values) {
+            return messageHandler(messageFormat, values...);
+          },
+          args);
+    }
+  };
+
+  struct Operations {
+    boost::format (*format)(const void *storage) noexcept;
+    /// construct value in the `to` storage and destroy value in `from`
+    void (*move)(void *to, void *from) noexcept;
+    void (*destroy)(void *storage) noexcept;
+  };
+
+  template <typename HolderType>
+  static constexpr Operations inlineOperations{
+      [](const void *storage) noexcept {
+        return static_cast<const HolderType *>(storage)->format();
+      },
+      [](void *to, void *from) noexcept {
+        HolderType *holder = static_cast<HolderType *>(from);
+        new (to) HolderType{std::move(*holder)};
+        holder->~HolderType();
+      },
+      [](void *storage) noexcept {
+        static_cast<HolderType *>(storage)->~HolderType();
+      }};
+
+  template <typename HolderType>
+  static constexpr Operations heapOperations{
+      [](const void *storage) noexcept {
+        return (*static_cast<HolderType *const *>(storage))->format();
+      },
+      [](void *to, void *from) noexcept {
+        new (to) HolderType *{*static_cast<HolderType **>(from)};
+      },
+      [](void *storage) noexcept {
+        delete *static_cast<HolderType **>(storage);
+      }};
+
+  void reset() noexcept {
+    if (operations_ != nullptr) {
+      operations_->destroy(storage_);
+      operations_ = nullptr;
+    }
+  }
+
+private:
+  alignas(std::max_align_t) unsigned char storage_[LOG_DEFERRED_INLINE_SIZE];
+  const Operations *operations_ = nullptr;
+};
+
 /**\brief combine message and metadata to one rectord for logging by
  * STANDARD_LOG_FORMAT
+ * \param threadId any printable identifier of thread
  * \see STANDARD_LOG_FORMAT
  */
-inline std::string
+template <typename ThreadId = std::thread::id>
+std::string
 getRecord(Severity                                           severity,
           std::string_view                                   fileName,
           int                                                lineNumber,
           std::string_view                                   functionName,
           std::chrono::time_point<std::chrono::system_clock> timePoint,
-          std::thread::id                                    threadId,
+          ThreadId                                           threadId,
           boost::format                                      message) noexcept {
   boost::format standardLogFormat{STANDARD_LOG_FORMAT};
   standardLogFormat.exceptions(boost::io::all_error_bits ^
@@ -195,6 +355,27 @@ public:
                    std::chrono::time_point<std::chrono::system_clock> timePoint,
                    std::thread::id                                    threadId,
                    boost::format message) noexcept = 0;
+
+  /**\brief same as log, but the message is formatted by the logger, so it can
+   * be done outside of calling thread. By default the message is formatted
+   * immediately
+   */
+  virtual void
+  logDeferred(Severity                                           severity,
+              std::string_view                                   fileName,
+              int                                                lineNumber,
+              std::string_view                                   functionName,
+              std::chrono::time_point<std::chrono::system_clock> timePoint,
+              std::thread::id                                    threadId,
+              DeferredMessage message) noexcept {
+    this->log(severity,
+              fileName,
+              lineNumber,
+              functionName,
+              timePoint,
+              threadId,
+              message.format());
+  }
 };
 
 /**\brief print log messages to terminal
@@ -236,9 +417,231 @@ private:
 
 class LoggerFactory final {
 public:
+  /**\return logger set by `set` or TerminalLogger if logger was not set
+   */
   static BasicLogger &get() noexcept {
+    if (BasicLogger *logger = current().load(std::memory_order_acquire)) {
+      return *logger;
+    }
     return TerminalLogger::get();
   }
+
+  /**\brief set logger for all following records. nullptr restores
+   * TerminalLogger
+   *
+   * \warning the logger must not be destroyed while it is set
+   */
+  static void set(BasicLogger *logger) noexcept {
+    current().store(logger, std::memory_order_release);
+  }
+
+private:
+  static std::atomic<BasicLogger *> &current() noexcept {
+    static std::atomic<BasicLogger *> logger{nullptr};
+    return logger;
+  }
+};
+
+/**\return level of the severity: record is written only if its level is not
+ * less then level of threshold
+ */
+constexpr int getLevel(Severity severity) noexcept {
+  switch (severity) {
+  case Severity::Debug:
+    return 0;
+  case Severity::Info:
+    return 1;
+  case Severity::Warning:
+    return 2;
+  case Severity::Error:
+    return 3;
+  case Severity::Throw:
+    return 4;
+  case Severity::Failure:
+    return 5;
+  }
+  return 0;
+}
+
+/**\brief named group of records with its own threshold
+ */
+class Category final {
+public:
+  Category(std::string_view name, Severity threshold) noexcept
+      : name_{name}
+      , threshold_{getLevel(threshold)} {
+  }
+
+  bool isEnabled(Severity severity) const noexcept {
+    return getLevel(severity) >= threshold_.load(std::memory_order_relaxed);
+  }
+
+  void setThreshold(Severity threshold) noexcept {
+    threshold_.store(getLevel(threshold), std::memory_order_relaxed);
+  }
+
+  const std::string &getName() const noexcept {
+    return name_;
+  }
+
+private:
+  Category(const Category &) = delete;
+  Category(Category &&)      = delete;
+
+private:
+  std::string      name_;
+  std::atomic<int> threshold_;
+};
+
+/**\brief contains all categories. Categories are never removed, so references
+ * to them are valid until end of the program
+ */
+class CategoryRegistry final {
+public:
+  /**\throw std::bad_alloc if categories from `LOG_LEVELS` can not be created
+   */
+  static CategoryRegistry &get() {
+    static CategoryRegistry registry;
+    return registry;
+  }
+
+  /**\return category with the name, category will be created if it doesn't
+   * exist
+   *
+   * \throw std::bad_alloc if the category can not be created
+   */
+  Category &getCategory(std::string_view name) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return this->getCategoryImp(name);
+  }
+
+  void setThreshold(std::string_view name, Severity threshold) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    this->getCategoryImp(name).setThreshold(threshold);
+  }
+
+  /**\brief set threshold for all existing categories and for categories,
+   * which will be created later
+   *
+   * \throw std::system_error if the registry can not be locked
+   */
+  void setThreshold(Severity threshold) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    defaultThreshold_ = threshold;
+    for (Category &category : categories_) {
+      category.setThreshold(threshold);
+    }
+  }
+
+  /**\brief set thresholds by specification like `name=level,name=level`.
+   * Level without name changes all categories. Valid levels: debug, info,
+   * warning, error, throw, failure
+   *
+   * \return false if the specification is invalid, in this case thresholds
+   * before first invalid item are applied
+   */
+  bool configure(std::string_view spec) {
+    while (spec.empty() == false) {
+      size_t           end  = spec.find(',');
+      std::string_view item = spec.substr(0, end);
+      spec = end == spec.npos ? std::string_view{} : spec.substr(end + 1);
+
+      size_t           eq    = item.find('=');
+      std::string_view level = eq == item.npos ? item : item.substr(eq + 1);
+
+      Severity threshold;
+      if (toSeverity(level, threshold) == false) {
+        return false;
+      }
+
+      if (eq == item.npos) {
+        this->setThreshold(threshold);
+      } else {
+        this->setThreshold(item.substr(0, eq), threshold);
+      }
+    }
+    return true;
+  }
+
+private:
+  CategoryRegistry()
+#ifdef NDEBUG
+      : defaultThreshold_{Severity::Warning} {
+#else
+      : defaultThreshold_{Severity::Debug} {
+#endif
+    if (const char *spec = std::getenv("LOG_LEVELS")) {
+      this->configure(spec);
+    }
+  }
+
+  CategoryRegistry(const CategoryRegistry &) = delete;
+  CategoryRegistry(CategoryRegistry &&)      = delete;
+
+  static bool toSeverity(std::string_view level, Severity &severity) noexcept {
+    const std::pair<std::string_view, Severity> levels[] = {
+        {"debug", Severity::Debug},
+        {"info", Severity::Info},
+        {"warning", Severity::Warning},
+        {"error", Severity::Error},
+        {"throw", Severity::Throw},
+        {"failure", Severity::Failure},
+    };
+
+    for (const auto &[name, value] : levels) {
+      if (name == level) {
+        severity = value;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  Category &getCategoryImp(std::string_view name) {
+    for (Category &category : categories_) {
+      if (category.getName() == name) {
+        return category;
+      }
+    }
+    return categories_.emplace_back(name, defaultThreshold_);
+  }
+
+private:
+  std::mutex           mutex_;
+  std::deque<Category> categories_;
+  Severity             defaultThreshold_;
+};
+
+/**\brief sampler for `LOG_EVERY_N_C`: allows every n-th call
+ */
+class EveryN final {
+public:
+  bool tick(size_t n) noexcept {
+    return n <= 1 || counter_.fetch_add(1, std::memory_order_relaxed) % n == 0;
+  }
+
+private:
+  std::atomic<size_t> counter_{0};
+};
+
+/**\brief limiter for `LOG_EVERY_MS_C`: allows not more then one call per the
+ * period
+ */
+class RateLimit final {
+public:
+  bool tick(std::chrono::milliseconds period) noexcept {
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now().time_since_epoch())
+                      .count();
+    int64_t last = last_.load(std::memory_order_relaxed);
+    if (last != 0 && now - last < std::chrono::nanoseconds{period}.count()) {
+      return false;
+    }
+    return last_.compare_exchange_strong(last, now, std::memory_order_relaxed);
+  }
+
+private:
+  std::atomic<int64_t> last_{0};
 };
 } // namespace logs
 
@@ -260,6 +663,86 @@ public:
                                  GET_LOG_THREAD_ID(),                          \
                                  message)
 
+#define LOG_DEFERRED_FORMAT(severity, message)                                 \
+  logs::LoggerFactory::get().logDeferred(severity,                             \
+                                         __FILE__,                             \
+                                         __LINE__,                             \
+                                         __func__,                             \
+                                         GET_LOG_TIME(),                       \
+                                         GET_LOG_THREAD_ID(),                  \
+                                         message)
+
+/**\brief reference to the category. Category is found in the registry only
+ * once for every call site
+ * \param name must be same for every call of the call site
+ */
+#define LOG_CATEGORY(name)                                                     \
+  [](std::string_view categoryName) -> logs::Category & {                      \
+    static logs::Category &category =                                          \
+        logs::CategoryRegistry::get().getCategory(categoryName);               \
+    return category;                                                           \
+  }(name)
+
+#define LOG_DEFAULT_CATEGORY "default"
+
+/**\brief write record to the category if the severity is enabled for it.
+ * Arguments are not evaluated if the severity is disabled
+ */
+#define LOG_C(severity, category, ...)                                         \
+  do {                                                                         \
+    if (LOG_CATEGORY(category).isEnabled(severity)) {                          \
+      LOG_FORMAT(severity, logs::messageHandler(__VA_ARGS__));                 \
+    }                                                                          \
+  } while (false)
+
+/**\brief same as LOG_C, but arguments are copied to the record and user
+ * message is formatted by the logger (AsyncLogger does it by background
+ * thread)
+ *
+ * \warning pointer arguments must be valid until the record will be written
+ * \see DeferredMessage
+ */
+#define LOG_ASYNC_C(severity, category, ...)                                   \
+  do {                                                                         \
+    if (LOG_CATEGORY(category).isEnabled(severity)) {                          \
+      LOG_DEFERRED_FORMAT(severity, logs::DeferredMessage(__VA_ARGS__));       \
+    }                                                                          \
+  } while (false)
+
+/**\brief same as LOG_C, but writes only every n-th record of the call site
+ */
+#define LOG_EVERY_N_C(severity, category, n, ...)                              \
+  do {                                                                         \
+    static logs::EveryN logEveryN;                                             \
+    if (LOG_CATEGORY(category).isEnabled(severity) && logEveryN.tick(n)) {     \
+      LOG_FORMAT(severity, logs::messageHandler(__VA_ARGS__));                 \
+    }                                                                          \
+  } while (false)
+
+/**\brief same as LOG_C, but writes not more then one record of the call site
+ * per the period in milliseconds
+ */
+#define LOG_EVERY_MS_C(severity, category, period, ...)                        \
+  do {                                                                         \
+    static logs::RateLimit logRateLimit;                                       \
+    if (LOG_CATEGORY(category).isEnabled(severity) &&                          \
+        logRateLimit.tick(std::chrono::milliseconds{period})) {                \
+      LOG_FORMAT(severity, logs::messageHandler(__VA_ARGS__));                 \
+    }                                                                          \
+  } while (false)
+
+#define LOG_INFO_C(category, ...)                                              \
+  LOG_C(logs::Severity::Info, category, __VA_ARGS__)
+
+#define LOG_DEBUG_C(category, ...)                                             \
+  LOG_C(logs::Severity::Debug, category, __VA_ARGS__)
+
+#define LOG_WARNING_C(category, ...)                                           \
+  LOG_C(logs::Severity::Warning, category, __VA_ARGS__)
+
+#define LOG_ERROR_C(category, ...)                                             \
+  LOG_C(logs::Severity::Error, category, __VA_ARGS__)
+
 #ifdef NDEBUG
 
 #  define LOG_INFO(...)
@@ -269,17 +752,13 @@ public:
 
 #else
 
-#  define LOG_INFO(...)                                                        \
-    LOG_FORMAT(logs::Severity::Info, logs::messageHandler(__VA_ARGS__))
+#  define LOG_INFO(...) LOG_INFO_C(LOG_DEFAULT_CATEGORY, __VA_ARGS__)
 
-#  define LOG_DEBUG(...)                                                       \
-    LOG_FORMAT(logs::Severity::Debug, logs::messageHandler(__VA_ARGS__))
+#  define LOG_DEBUG(...) LOG_DEBUG_C(LOG_DEFAULT_CATEGORY, __VA_ARGS__)
 
-#  define LOG_WARNING(...)                                                     \
-    LOG_FORMAT(logs::Severity::Warning, logs::messageHandler(__VA_ARGS__))
+#  define LOG_WARNING(...) LOG_WARNING_C(LOG_DEFAULT_CATEGORY, __VA_ARGS__)
 
-#  define LOG_ERROR(...)                                                       \
-    LOG_FORMAT(logs::Severity::Error, logs::messageHandler(__VA_ARGS__))
+#  define LOG_ERROR(...) LOG_ERROR_C(LOG_DEFAULT_CATEGORY, __VA_ARGS__)
 
 #endif
 
@@ -292,10 +771,21 @@ public:
 /**\brief print log and generate specified exception
  * \param ExceptionType type of generated exception
  * \warning work even if `NDEBUG` defined
+ * \note if exceptions are disabled (`-fno-exceptions`), then the program is
+ * aborted after printing log
  */
-#define LOG_THROW(ExceptionType, ...)                                          \
-  {                                                                            \
-    boost::format fmt = logs::messageHandler(__VA_ARGS__);                     \
-    LOG_FORMAT(logs::Severity::Throw, fmt);                                    \
-    throw ExceptionType{fmt.str()};                                            \
-  }
+#ifdef __cpp_exceptions
+#  define LOG_THROW(ExceptionType, ...)                                        \
+    {                                                                          \
+      boost::format fmt = logs::messageHandler(__VA_ARGS__);                   \
+      LOG_FORMAT(logs::Severity::Throw, fmt);                                  \
+      throw ExceptionType{fmt.str()};                                          \
+    }
+#else
+#  define LOG_THROW(ExceptionType, ...)                                        \
+    {                                                                          \
+      boost::format fmt = logs::messageHandler(__VA_ARGS__);                   \
+      LOG_FORMAT(logs::Severity::Throw, fmt);                                  \
+      std::abort();                                                            \
+    }
+#endif
@@ -24,27 +24,71 @@
 
 #pragma once
 
+#include "svc/FastPimpl.hpp"
+#include "svc/Status.hpp"
 #include "svc/base_geometry_types.hpp"
+#include <cstddef>
+#include <iterator>
 #include <list>
 #include <memory>
 
+/**\brief size and alignment of storage for AbstractItemImp, must be changed
+ * after changing of AbstractItemImp (checked at compile time)
+ */
+#define ABSTRACT_ITEM_IMP_SIZE      72
+#define ABSTRACT_ITEM_IMP_ALIGNMENT 4
+
 namespace svc {
 class Scene;
+class SceneImp;
 class AbstractItemImp;
 class AbstractVisitor;
 
 class AbstractItem;
 using ItemPtr = std::shared_ptr<AbstractItem>;
 
+class SubtreeIterator;
+
+/**\brief non-owning range, can be used in range-based for
+ */
+template <typename Iterator>
+class Range {
+public:
+  Range(Iterator begin, Iterator end) noexcept
+      : begin_{begin}
+      , end_{end} {
+  }
+
+  Iterator begin() const noexcept {
+    return begin_;
+  }
+
+  Iterator end() const noexcept {
+    return end_;
+  }
+
+  bool empty() const noexcept {
+    return begin_ == end_;
+  }
+
+private:
+  Iterator begin_;
+  Iterator end_;
+};
+
 /**\brief provide functionality for describing some kind of Item on Scene.
  * Realised as Compositor
  * \todo think about scaling - is this needed?
  */
 class AbstractItem {
   friend Scene;
+  friend SceneImp;
+  friend SubtreeIterator;
 
 public:
-  using Children = std::list<ItemPtr>;
+  using Children     = std::list<ItemPtr>;
+  using ChildRange   = Range<Children::const_iterator>;
+  using SubtreeRange = Range<SubtreeIterator>;
 
   AbstractItem() noexcept;
   virtual ~AbstractItem() noexcept;
@@ -167,6 +211,14 @@ public:
    */
   void removeChild(AbstractItem *child);
 
+  /**\brief same as removeChild, but reports misses by status instead of
+   * exception
+   *
+   * \return Status::Ok if the child was removed, Status::NotFound if the Item
+   * is not parent of the child
+   */
+  Status tryRemoveChild(AbstractItem *child);
+
   /**\return list of all leaf nodes of the Item (not includes leaf nodes of
    * children Items)
    *
@@ -174,6 +226,20 @@ public:
    */
   Children getChildren() const noexcept;
 
+  /**\return range of children of the Item without copying
+   *
+   * \warning the range is invalidated by appending or removing children
+   */
+  ChildRange getChildrenRange() const noexcept;
+
+  /**\return range of all descendants of the Item (children, children of
+   * children etc, without the Item) in pre-order. Iteration doesn't allocate
+   * memory
+   *
+   * \warning the range is invalidated by changing of hierarchy of the subtree
+   */
+  SubtreeRange getSubtree() const noexcept;
+
   /**\return true if the Item don't has any child
    */
   bool empty() const noexcept;
@@ -195,6 +261,11 @@ protected:
   Matrix getMatrix() const noexcept;
 
   /**\return affine transformation matrix for the Item relatively to Scene
+   *
+   * \note the matrix is cached, so in common case it is O(1). After changing
+   * position of some parent the matrix is recalculated by first call
+   *
+   * \warning the cache is updated by the call, so the call is not thread-safe
    */
   Matrix getSceneMatrix() const noexcept;
 
@@ -205,12 +276,117 @@ protected:
 private:
   void setScene(Scene *scene) noexcept;
 
+  /**\brief remove the child from children of the Item, but don't remove it
+   * from Scene. Scene position of the child is not changed
+   *
+   * \warning the child must be owned by someone else, because the Item
+   * releases its ownership
+   */
+  void unlinkChild(AbstractItem *child) noexcept;
+
+  /**\return same as getMatrix, but in compact form
+   */
+  const Affine &getTransform() const noexcept;
+
+  /**\return same as getSceneMatrix, but in compact form
+   */
+  const Affine &getSceneTransform() const noexcept;
+
+  /**\brief mark cached Scene matrices of the Item and all its children as
+   * dirty
+   */
+  void invalidateSceneMatrix() noexcept;
+
 private:
-  AbstractItemImp *imp_;
+  FastPimpl<AbstractItemImp, ABSTRACT_ITEM_IMP_SIZE, ABSTRACT_ITEM_IMP_ALIGNMENT>
+      imp_;
 
   Scene *scene_;
 
   AbstractItem *parent_;
   Children      children_;
+
+  /// position of the Item in children of its parent, valid only if parent set
+  Children::iterator position_;
+};
+
+/**\brief pre-order iterator over descendants of some Item. Uses only links
+ * between Items, so it doesn't allocate memory
+ *
+ * \see AbstractItem::getSubtree
+ */
+class SubtreeIterator {
+public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type        = ItemPtr;
+  using difference_type   = std::ptrdiff_t;
+  using pointer           = const ItemPtr *;
+  using reference         = const ItemPtr &;
+
+  /**\brief end iterator
+   */
+  SubtreeIterator() noexcept
+      : root_{nullptr}
+      , current_{} {
+  }
+
+  /**\brief iterator to first child of the root
+   */
+  explicit SubtreeIterator(const AbstractItem *root) noexcept
+      : root_{root->children_.empty() ? nullptr : root}
+      , current_{root->children_.begin()} {
+  }
+
+  reference operator*() const noexcept {
+    return *current_;
+  }
+
+  pointer operator->() const noexcept {
+    return &*current_;
+  }
+
+  SubtreeIterator &operator++() noexcept {
+    const AbstractItem *item = current_->get();
+    if (item->children_.empty() == false) {
+      current_ = item->children_.begin();
+      return *this;
+    }
+
+    // go up until some Item has next sibling
+    while (item != root_) {
+      const AbstractItem *parent = item->parent_;
+      auto                next   = std::next(item->position_);
+      if (next != parent->children_.end()) {
+        current_ = next;
+        return *this;
+      }
+      item = parent;
+    }
+
+    root_ = nullptr;
+    return *this;
+  }
+
+  SubtreeIterator operator++(int) noexcept {
+    SubtreeIterator retval = *this;
+    ++(*this);
+    return retval;
+  }
+
+  bool operator==(const SubtreeIterator &rhs) const noexcept {
+    if (root_ == nullptr || rhs.root_ == nullptr) {
+      return root_ == rhs.root_;
+    }
+    return current_ == rhs.current_;
+  }
+
+  bool operator!=(const SubtreeIterator &rhs) const noexcept {
+    return !(*this == rhs);
+  }
+
+private:
+  /// nullptr for end iterator
+  const AbstractItem *                   root_;
+  AbstractItem::Children::const_iterator current_;
 };
 } // namespace svc
@@ -8,10 +8,18 @@
 
 #pragma once
 
+#include "FastPimpl.hpp"
 #include "base_geometry_types.hpp"
 
+/**\brief size and alignment of storage for AbstractViewImp, must be changed
+ * after changing of AbstractViewImp (checked at compile time)
+ */
+#define ABSTRACT_VIEW_IMP_SIZE      120
+#define ABSTRACT_VIEW_IMP_ALIGNMENT 8
+
 namespace svc {
 class Scene;
+class SceneSnapshot;
 class AbstractVisitor;
 
 class AbstractViewImp;
@@ -62,9 +70,24 @@ public:
 
   /**\brief iterate all Items (without hierarchy) in Scene Rect and call accept
    * method for each
+   *
+   * \note visitor can remove Items from the Scene: found Items are held by
+   * the View until end of the call
+   *
+   * \warning results of the query are stored in reusable buffer of the View,
+   * so accept is not reentrant
    */
   void accept(AbstractVisitor *visitor);
 
+  /**\brief same as accept, but query Items from the snapshot instead of the
+   * Scene. Can be called concurrently with changing of the Scene
+   *
+   * \note visitor should get transformations of Items from the snapshot
+   *
+   * \see Scene::snapshot
+   */
+  void accept(AbstractVisitor *visitor, const SceneSnapshot &snapshot);
+
 protected:
   /**\return transformation matrix for transform points in View koordinates to
    * Scene koordinates
@@ -77,8 +100,18 @@ protected:
    */
   Point mapToScene(Point viewPoint) const noexcept;
 
+  /**\brief map count View points to Scene points at once, faster then mapping
+   * of every point separately
+   *
+   * \note scenePoints can be same as viewPoints
+   */
+  void mapToScene(const Point *viewPoints,
+                  Point *      scenePoints,
+                  size_t       count) const noexcept;
+
 private:
-  AbstractViewImp *imp_;
+  FastPimpl<AbstractViewImp, ABSTRACT_VIEW_IMP_SIZE, ABSTRACT_VIEW_IMP_ALIGNMENT>
+      imp_;
 
   ScenePtr scene_;
 };
@@ -0,0 +1,70 @@
+// BatchTransform.hpp
+/**\file contains kernels, which transform arrays of points, boxes and
+ * transformations at once
+ *
+ * Kernels are vectorized (SSE2 or AVX2, if the processor supports it) and
+ * implementation is selected at runtime, so the library doesn't require any
+ * special compiler flags. On other architectures only scalar implementation is
+ * available
+ *
+ * \note results of all implementations are same as results of functions from
+ * base_geometry_types.hpp (transformPoint, transformBox, operator*), because
+ * operations are done in same order
+ */
+
+#pragma once
+
+#include "base_geometry_types.hpp"
+
+namespace svc {
+enum class BatchKernel {
+  Scalar,
+  Sse2,
+  Avx2,
+};
+
+/**\return text description of the kernel
+ */
+const char *toString(BatchKernel kernel) noexcept;
+
+/**\return implementation currently used by batch functions. By default it is
+ * the best implementation supported by the processor
+ */
+BatchKernel getBatchKernel() noexcept;
+
+/**\brief force using of the implementation. Needed mostly for testing and
+ * benchmarking
+ *
+ * \return false if the processor doesn't support the implementation, in this
+ * case current implementation is not changed
+ */
+bool setBatchKernel(BatchKernel kernel) noexcept;
+
+/**\brief same as `out[i] = transformPoint(aff, points[i])` for every point
+ *
+ * \note out can be same as points
+ */
+void transformPoints(const Affine &aff,
+                     const Point * points,
+                     Point *       out,
+                     size_t        count) noexcept;
+
+/**\brief same as `out[i] = transformBox(transforms[i], boxes[i])` for every
+ * box
+ *
+ * \note out can be same as boxes
+ */
+void transformBoxes(const Affine *transforms,
+                    const Box *   boxes,
+                    Box *         out,
+                    size_t        count) noexcept;
+
+/**\brief same as `out[i] = lhs[i] * rhs[i]` for every pair
+ *
+ * \note out can be same as lhs or rhs
+ */
+void composeTransforms(const Affine *lhs,
+                       const Affine *rhs,
+                       Affine *      out,
+                       size_t        count) noexcept;
+} // namespace svc
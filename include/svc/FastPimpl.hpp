@@ -0,0 +1,84 @@
+// FastPimpl.hpp
+/**\file provide storage for implementation of Bridge without heap allocation
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace svc {
+/**\brief owns object of type T, which is placed inside the FastPimpl, so
+ * creating of the owner doesn't need additional allocation. T can be
+ * incomplete type in the header of the owner, but constructor and destructor
+ * of the owner must be defined where T is complete
+ *
+ * \param Size must be not less then size of T, checked at compile time
+ *
+ * \param Alignment must be multiple of alignment of T, checked at compile time
+ *
+ * \note for changing T you need change only the Size in the header, so the
+ * storage still hides implementation (but not its size)
+ */
+template <typename T, size_t Size, size_t Alignment = alignof(std::max_align_t)>
+class FastPimpl final {
+public:
+  template <typename... Args>
+  explicit FastPimpl(Args &&... args) noexcept(
+      std::is_nothrow_constructible_v<T, Args...>) {
+    validate<sizeof(T), alignof(T)>();
+    new (&storage_) T(std::forward<Args>(args)...);
+  }
+
+  ~FastPimpl() noexcept {
+    validate<sizeof(T), alignof(T)>();
+    this->get()->~T();
+  }
+
+  T *operator->() noexcept {
+    return this->get();
+  }
+
+  const T *operator->() const noexcept {
+    return this->get();
+  }
+
+  T &operator*() noexcept {
+    return *this->get();
+  }
+
+  const T &operator*() const noexcept {
+    return *this->get();
+  }
+
+private:
+  FastPimpl(const FastPimpl &) = delete;
+  FastPimpl(FastPimpl &&)      = delete;
+  FastPimpl &operator=(const FastPimpl &) = delete;
+  FastPimpl &operator=(FastPimpl &&) = delete;
+
+  T *get() noexcept {
+    return std::launder(reinterpret_cast<T *>(&storage_));
+  }
+
+  const T *get() const noexcept {
+    return std::launder(reinterpret_cast<const T *>(&storage_));
+  }
+
+  /**\brief sizes are template arguments, so compiler prints them on failure
+   */
+  template <size_t ActualSize, size_t ActualAlignment>
+  static constexpr void validate() noexcept {
+    static_assert(Size >= ActualSize,
+                  "size of FastPimpl storage is too small for the type");
+    static_assert(Alignment % ActualAlignment == 0,
+                  "alignment of FastPimpl storage is not compatible with the "
+                  "type");
+  }
+
+private:
+  std::aligned_storage_t<Size, Alignment> storage_;
+};
+} // namespace svc
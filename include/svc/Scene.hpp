@@ -8,12 +8,32 @@
 
 #pragma once
 
+#include "svc/FastPimpl.hpp"
+#include "svc/SceneStats.hpp"
+#include "svc/Status.hpp"
 #include "svc/base_geometry_types.hpp"
+#include <cstdint>
 #include <list>
 #include <memory>
+#include <memory_resource>
+#include <optional>
+#include <vector>
+
+/**\brief size and alignment of storage for SceneImp, must be changed after
+ * changing of SceneImp (checked at compile time). Statistic recorder (see
+ * SVC_SCENE_STATS) is a member of SceneImp only if it is enabled, so the size
+ * depends on configuration
+ */
+#ifdef SVC_SCENE_STATS
+#  define SCENE_IMP_SIZE 184
+#else
+#  define SCENE_IMP_SIZE 176
+#endif
+#define SCENE_IMP_ALIGNMENT 8
 
 namespace svc {
 class SceneImp;
+class SceneSnapshotImp;
 
 class AbstractVisitor;
 
@@ -22,21 +42,111 @@ using ItemPtr = std::shared_ptr<AbstractItem>;
 
 using ItemList = std::list<ItemPtr>;
 
+/**\brief contiguous buffer for results of queries. Can be reused between
+ * queries, so memory is allocated only when the buffer grows
+ *
+ * \warning the buffer doesn't own Items, so pointers are valid only until the
+ * Items are removed from the Scene
+ */
+using ItemBuffer = std::vector<AbstractItem *>;
+
+/**\brief same as ItemBuffer, but the buffer holds Items, so they stay valid
+ * even if they are removed from the Scene while results are used
+ */
+using SharedItemBuffer = std::vector<ItemPtr>;
+
+class SceneSnapshot;
+using SceneSnapshotPtr = std::shared_ptr<const SceneSnapshot>;
+
+/**\brief user-defined bits, which Scene stores next to bounding box of every
+ * Item. Can be used for filtering queries inside spatial index
+ *
+ * \see ItemFilter
+ */
+using ItemFlags = uint32_t;
+
+/**\brief filter for queries by ItemFlags. Item pass the filter only if it has
+ * all `required` bits and has not any of `forbidden` bits
+ *
+ * \note default filter accept all Items
+ */
+struct ItemFilter {
+  ItemFlags required  = 0;
+  ItemFlags forbidden = 0;
+
+  inline bool accept(ItemFlags flags) const noexcept {
+    return (flags & required) == required && (flags & forbidden) == 0;
+  }
+
+  /**\return true if the filter accept any flags
+   */
+  inline bool empty() const noexcept {
+    return required == 0 && forbidden == 0;
+  }
+};
+
+/**\brief result of raycasting
+ *
+ * \see Scene::raycast
+ */
+struct RayHit {
+  ItemPtr item;
+
+  /// distance from origin of the ray to the first intersection with the Item
+  float distance;
+};
+
 /**\brief Scene provide 2D infinity space in cartesian koordinate system.
  * Provide functional for append, remove and move Items. Support quires
  * operations, saving and restoring
  */
 class Scene {
+  friend AbstractItem;
+
 public:
   enum class SpatialIndex {
     Intersects,
-    /// only for Box, cause undefined behaviour for Ring
     Within,
   };
 
+  /**\brief additional checks for ray and segment casts
+   */
+  enum class Refinement {
+    /// check only boxes from spatial index
+    None,
+    /// also check bounding box of Item, transformed by its Scene matrix (so
+    /// rotation and scale of the Item are considered)
+    BoundingShape,
+  };
+
+  /**\brief Scene uses own pool resource for spatial index and internal
+   * containers
+   */
   Scene() noexcept;
+
+  /**\param resource memory resource for spatial index and internal
+   * containers of the Scene. Can be pool or monotonic arena
+   *
+   * \warning resource must outlive the Scene. Scene doesn't synchronize access
+   * to the resource
+   */
+  explicit Scene(std::pmr::memory_resource *resource) noexcept;
+
   virtual ~Scene() noexcept;
 
+  /**\brief preallocate memory of spatial index and internal containers for n
+   * Items, so appending and updating Items will not touch global heap
+   *
+   * \note nodes of spatial index are preallocated only if the Scene uses
+   * standard pool resource (own or provided by user): blocks of node size are
+   * allocated from the pool and returned back to it. Other resources can not
+   * reuse freed memory, so for them only internal vectors are reserved
+   *
+   * \note queries, which return ItemList, still allocate the result from
+   * global heap. Use overloads with ItemBuffer for avoiding it
+   */
+  void reserve(size_t n);
+
   /**\brief add Item to scene. If the Item has some children they also will be
    * added to the Scene
    *
@@ -55,21 +165,70 @@ public:
    * already associated with Scene of when it will be associated with some
    * Scene)
    *
-   * \warning produce undefined behaviour if Item don't associated with the
-   * Scene
+   * \throw exception if Item not associated with the Scene
    *
    * \warning produce undefined behaviour if parent of added Item not associated
    * wiht the Scene
    */
   void removeItem(AbstractItem *item);
 
+  /**\brief same as removeItem, but reports misses by status instead of
+   * exception. Nothing is changed if the Item is not associated with the Scene
+   *
+   * \return Status::Ok if the Item was removed. If the Item or some of its
+   * descendants was not found in spatial index, then the subtree is removed
+   * anyway and first failure is returned
+   */
+  Status tryRemoveItem(AbstractItem *item);
+
   /**\brief Item, after change own position, must notificate the Scene about it
-   * for update spatial indicies
+   * for update spatial indicies. All descendants of the Item are reindexed
+   * too, by one batch
    *
-   * \note item must be associated with the Scene
+   * \throw exception if Item not associated with the Scene
    */
   void updateItemPosition(AbstractItem *item);
 
+  /**\brief same as updateItemPosition, but reports misses by status instead of
+   * exception
+   *
+   * \return Status::Ok if position of the Item was updated
+   */
+  Status tryUpdateItemPosition(AbstractItem *item);
+
+  /**\brief set user flags for the Item. Changing of flags doesn't reindex
+   * geometry of the Item
+   *
+   * \note flags are reset to 0 when the Item is removed from the Scene
+   *
+   * \throw exception if Item not associated with the Scene
+   *
+   * \see ItemFilter
+   */
+  void setItemFlags(AbstractItem *item, ItemFlags flags);
+
+  /**\return user flags of the Item
+   *
+   * \throw exception if Item not associated with the Scene
+   */
+  ItemFlags getItemFlags(AbstractItem *item) const;
+
+  /**\brief move Items from source Scene to the Scene. Every root Item
+   * (Item without parent) of source Scene, which intersects the region, is
+   * moved with all its children. Flags of moved Items are saved
+   *
+   * \note moved Items are removed from source and inserted to the Scene in
+   * bulk, so it is much faster then appending the Items one by one
+   */
+  void transferFrom(Scene &source, Box region);
+
+  /**\brief remove from the Scene all root Items (Items without parent), which
+   * intersect the region. Root Items are removed with all its children
+   *
+   * \return removed root Items. Hierarchy of Items is saved
+   */
+  ItemList extract(Box region);
+
   /**\return count of items
    */
   size_t count() const noexcept;
@@ -86,22 +245,224 @@ public:
   Box bounds() const noexcept;
 
   /**\brief spatial query by Point
+   *
+   * \param filter checks flags of Items while traversing the spatial index
    */
-  ItemList query(Point pos) const noexcept;
+  ItemList query(Point pos, ItemFilter filter = {}) const noexcept;
 
   /**\brief spatial query by Box
    */
-  ItemList query(Box box, SpatialIndex index = SpatialIndex::Intersects) const
-      noexcept;
+  ItemList query(Box          box,
+                 SpatialIndex index  = SpatialIndex::Intersects,
+                 ItemFilter   filter = {}) const noexcept;
+
+  /**\brief spatial query by polygon. Traverse the spatial index by envelope
+   * of the polygon and check exact relation only for found Items
+   *
+   * \note ring must be valid, but can be non-convex
+   */
+  ItemList query(Ring         ring,
+                 SpatialIndex index  = SpatialIndex::Intersects,
+                 ItemFilter   filter = {}) const noexcept;
+
+  /**\note polygon must be valid, can be non-convex and can have holes
+   *
+   * \see query(Ring, SpatialIndex, ItemFilter)
+   */
+  ItemList query(Polygon      polygon,
+                 SpatialIndex index  = SpatialIndex::Intersects,
+                 ItemFilter   filter = {}) const noexcept;
+
+  /**\brief query by several polygons at once. Every Item is returned only
+   * once, even if it intersects several polygons
+   *
+   * \see query(Ring, SpatialIndex, ItemFilter)
+   */
+  ItemList query(MultiPolygon multiPolygon,
+                 SpatialIndex index  = SpatialIndex::Intersects,
+                 ItemFilter   filter = {}) const noexcept;
 
-  ItemList query(Ring ring, SpatialIndex index = SpatialIndex::Intersects) const
+  /**\brief same as query by Point, but fills the buffer instead of creating
+   * new list. Buffer is cleared before the query
+   *
+   * \see ItemBuffer
+   */
+  void query(Point pos, ItemBuffer &out, ItemFilter filter = {}) const
       noexcept;
 
+  /**\see query(Point, ItemBuffer &, ItemFilter)
+   */
+  void query(Box          box,
+             ItemBuffer & out,
+             SpatialIndex index  = SpatialIndex::Intersects,
+             ItemFilter   filter = {}) const noexcept;
+
+  /**\see query(Point, ItemBuffer &, ItemFilter)
+   */
+  void query(const Ring & ring,
+             ItemBuffer & out,
+             SpatialIndex index  = SpatialIndex::Intersects,
+             ItemFilter   filter = {}) const noexcept;
+
+  /**\brief same as query by Ring into ItemBuffer, but the buffer holds found
+   * Items. Needed if Items can be removed from the Scene while results are
+   * used (by visitors, for example)
+   *
+   * \see SharedItemBuffer
+   */
+  void query(const Ring &       ring,
+             SharedItemBuffer & out,
+             SpatialIndex       index  = SpatialIndex::Intersects,
+             ItemFilter         filter = {}) const noexcept;
+
+  /**\see query(Point, ItemBuffer &, ItemFilter)
+   */
+  void query(const Polygon &polygon,
+             ItemBuffer &   out,
+             SpatialIndex   index  = SpatialIndex::Intersects,
+             ItemFilter     filter = {}) const noexcept;
+
+  /**\see query(Point, ItemBuffer &, ItemFilter)
+   */
+  void query(const MultiPolygon &multiPolygon,
+             ItemBuffer &        out,
+             SpatialIndex        index  = SpatialIndex::Intersects,
+             ItemFilter          filter = {}) const noexcept;
+
+  /**\brief spatial query by circle
+   *
+   * \return Items, which index boxes intersect the circle
+   */
+  ItemList queryRadius(Point      center,
+                       float      radius,
+                       ItemFilter filter = {}) const noexcept;
+
+  /**\brief same as queryRadius, but Items are sorted by distance from center
+   * to their index boxes (nearest first)
+   *
+   * \see queryRadius
+   */
+  ItemList queryRadiusSorted(Point      center,
+                             float      radius,
+                             ItemFilter filter = {}) const noexcept;
+
+  /**\brief spatial query by Segment
+   *
+   * \return all Items intersected by the segment, ordered by distance from
+   * first point of the segment
+   */
+  ItemList query(Segment    segment,
+                 ItemFilter filter     = {},
+                 Refinement refinement = Refinement::None) const noexcept;
+
+  /**\brief find first Item on the ray. Spatial index is traversed in order of
+   * distance from origin, so traversing stops right after the first hit
+   *
+   * \param direction vector of the ray, must not be zero
+   *
+   * \param maxDist length of the ray
+   *
+   * \return nothing if the ray doesn't intersect any Item
+   */
+  std::optional<RayHit>
+  raycast(Point      origin,
+          Point      direction,
+          float      maxDist,
+          ItemFilter filter     = {},
+          Refinement refinement = Refinement::None) const noexcept;
+
   /**\brief iterate all main Items (without parents) and call accept method
    */
   void accept(AbstractVisitor *visitor);
 
+  /**\brief take read-only snapshot of current state of the Scene. The
+   * snapshot can be used from other thread, while the Scene is changing.
+   *
+   * Scene keeps two snapshots and updates them in turn, so taking snapshot
+   * costs O(changed Items) if previous but one snapshot is already released by
+   * all readers. Otherwise snapshot will be created from scratch
+   *
+   * \warning must be called from the thread which changes the Scene
+   */
+  SceneSnapshotPtr snapshot();
+
+  /**\return statistic of operations (appending, removing, updating and
+   * queries) since creation of the Scene or last reset
+   *
+   * \param reset if true, then all counters will be reset
+   *
+   * \note statistic is collected only if the library was compiled with
+   * `SVC_SCENE_STATS`, otherwise returned statistic is empty and not enabled
+   */
+  SceneStats stats(bool reset = false) noexcept;
+
+private:
+  /**\brief Item must notify the Scene about changing of its transformation,
+   * which doesn't change its bounding box in the Scene (for example rotation
+   * around own center)
+   */
+  void updateItemTransform(AbstractItem *item) noexcept;
+
+private:
+  FastPimpl<SceneImp, SCENE_IMP_SIZE, SCENE_IMP_ALIGNMENT> imp_;
+};
+
+/**\brief read-only state of Scene: spatial index, flags and Scene matrices of
+ * Items at the moment of taking the snapshot. All methods are thread-safe
+ *
+ * \see Scene::snapshot
+ */
+class SceneSnapshot {
+  friend SceneImp;
+
+public:
+  ~SceneSnapshot() noexcept;
+
+  size_t count() const noexcept;
+
+  bool empty() const noexcept;
+
+  Box bounds() const noexcept;
+
+  ItemList query(Point pos, ItemFilter filter = {}) const noexcept;
+
+  ItemList query(Box                 box,
+                 Scene::SpatialIndex index  = Scene::SpatialIndex::Intersects,
+                 ItemFilter          filter = {}) const noexcept;
+
+  ItemList query(Ring                ring,
+                 Scene::SpatialIndex index  = Scene::SpatialIndex::Intersects,
+                 ItemFilter          filter = {}) const noexcept;
+
+  /**\note pointers in the buffer are valid while the snapshot exists
+   *
+   * \see Scene::query(Point, ItemBuffer &, ItemFilter)
+   */
+  void query(Point pos, ItemBuffer &out, ItemFilter filter = {}) const
+      noexcept;
+
+  void query(Box                 box,
+             ItemBuffer &        out,
+             Scene::SpatialIndex index  = Scene::SpatialIndex::Intersects,
+             ItemFilter          filter = {}) const noexcept;
+
+  void query(const Ring &        ring,
+             ItemBuffer &        out,
+             Scene::SpatialIndex index  = Scene::SpatialIndex::Intersects,
+             ItemFilter          filter = {}) const noexcept;
+
+  /**\return Scene matrix of the Item at the moment of taking the snapshot.
+   * Return nothing if the Item was not associated with the Scene
+   */
+  std::optional<Matrix> getSceneMatrix(const AbstractItem *item) const noexcept;
+
+private:
+  SceneSnapshot() noexcept;
+
+  SceneSnapshot(const SceneSnapshot &) = delete;
+  SceneSnapshot &operator=(const SceneSnapshot &) = delete;
+
 private:
-  SceneImp *imp_;
+  SceneSnapshotImp *imp_;
 };
 } // namespace svc
@@ -0,0 +1,124 @@
+// SceneStats.hpp
+/**\file contains statistic of Scene operations
+ *
+ * \note statistic is collected only if library was compiled with
+ * `SVC_SCENE_STATS` (cmake option `scene_stats`)
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace svc {
+/**\brief log-linear (HDR-style) histogram of latencies in nanoseconds. Every
+ * power of two range is divided on SubBucketsCount linear sub-buckets, so
+ * relative error of percentiles is not greater then 1/SubBucketsCount for any
+ * magnitude of values
+ */
+class LatencyHistogram {
+public:
+  static constexpr size_t SubBucketBits   = 4;
+  static constexpr size_t SubBucketsCount = 1 << SubBucketBits;
+
+  /// first SubBucketsCount values are stored exactly
+  static constexpr size_t BucketsCount =
+      SubBucketsCount + (64 - SubBucketBits) * SubBucketsCount;
+
+  using Buckets = std::array<uint64_t, BucketsCount>;
+
+  /**\return index of bucket for the value
+   */
+  static size_t bucketIndex(uint64_t value) noexcept;
+
+  /**\return minimal value, which belongs to the bucket
+   */
+  static uint64_t bucketLowerBound(size_t index) noexcept;
+
+  /**\return maximal value, which belongs to the bucket
+   */
+  static uint64_t bucketUpperBound(size_t index) noexcept;
+
+  LatencyHistogram() noexcept;
+
+  void record(uint64_t value) noexcept;
+
+  /**\param q in range [0, 1]
+   *
+   * \return upper bound of bucket, which contains the percentile. Return 0 if
+   * histogram is empty
+   */
+  uint64_t percentile(double q) const noexcept;
+
+  uint64_t count() const noexcept;
+  uint64_t sum() const noexcept;
+  uint64_t min() const noexcept;
+  uint64_t max() const noexcept;
+
+  const Buckets &buckets() const noexcept;
+
+private:
+  friend class SceneStatsRecorder;
+
+  Buckets  buckets_;
+  uint64_t count_;
+  uint64_t sum_;
+  uint64_t min_;
+  uint64_t max_;
+};
+
+enum class SceneOperation : size_t {
+  Append,
+  Remove,
+  Update,
+  Query,
+  Count_,
+};
+
+const char *toString(SceneOperation operation) noexcept;
+
+struct OperationStats {
+  uint64_t count = 0;
+
+  /**\brief count of values, which were found in spatial index before exact
+   * checks (distance, relation with polygon, etc). Only for queries
+   *
+   * \note Boost.Geometry doesn't provide count of visited nodes of the index,
+   * so it is the closest available measure of work done by queries
+   */
+  uint64_t candidates = 0;
+
+  /// count of Items returned by queries
+  uint64_t hits = 0;
+
+  LatencyHistogram latency;
+};
+
+/**\brief statistic of the Scene at some moment
+ *
+ * \see Scene::stats
+ */
+struct SceneStats {
+  enum class Format {
+    Json,
+    Prometheus,
+  };
+
+  /// false if the library was compiled without statistic
+  bool enabled = false;
+
+  std::array<OperationStats, size_t(SceneOperation::Count_)> operations;
+
+  const OperationStats &operator[](SceneOperation operation) const noexcept;
+
+  void write(std::ostream &out, Format format) const;
+
+  /**\brief write the statistic to the file (file will be rewritten)
+   *
+   * \throw exception if the file can not be written
+   */
+  void dump(const std::string &fileName, Format format) const;
+};
+} // namespace svc
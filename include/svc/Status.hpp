@@ -0,0 +1,27 @@
+// Status.hpp
+/**\file contains result of non-throwing operations with Scene and Items
+ */
+
+#pragma once
+
+namespace svc {
+/**\brief result of non-throwing operations (`tryRemoveItem`,
+ * `tryUpdateItemPosition`, `tryRemoveChild`)
+ */
+enum class Status {
+  Ok,
+
+  /// nullptr was passed as Item
+  InvalidArgument,
+
+  /// Item is not associated with the Scene or child has different parent
+  NotFound,
+
+  /// Item is associated with the Scene, but not found in spatial index
+  NotIndexed,
+};
+
+/**\return text description of the status
+ */
+const char *toString(Status status) noexcept;
+} // namespace svc
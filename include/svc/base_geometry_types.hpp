@@ -5,13 +5,17 @@
 #pragma once
 
 #include <boost/geometry/geometries/box.hpp>
+#include <boost/geometry/geometries/multi_polygon.hpp>
+#include <boost/geometry/geometries/polygon.hpp>
 #include <boost/geometry/geometries/ring.hpp>
+#include <boost/geometry/geometries/segment.hpp>
 #include <boost/qvm/mat.hpp>
 #include <boost/qvm/mat_operations.hpp>
 #include <boost/qvm/vec.hpp>
 #include <boost/qvm/vec_mat_operations.hpp>
 #include <boost/qvm/vec_operations.hpp>
 #include <boost/qvm/vec_traits.hpp>
+#include <cmath>
 
 #define TO_RAD(angle) ((angle) * (M_PI / 180.))
 
@@ -90,10 +94,20 @@ using Point  = Point_<float>;
 using Size   = Size_<float>;
 using Box    = bg::model::box<Point>;
 
-/**\brief clockwised (in cartesian koordinate system) convex polygon
+using Segment = bg::model::segment<Point>;
+
+/**\brief clockwised (in cartesian koordinate system) polygon without holes.
+ * Can be non-convex
  */
 using Ring = bg::model::ring<Point, true, false>;
 
+/**\brief clockwised (in cartesian koordinate system) polygon with holes
+ * (holes are counterclockwised)
+ */
+using Polygon = bg::model::polygon<Point, true, false>;
+
+using MultiPolygon = bg::model::multi_polygon<Polygon>;
+
 using ScaleFactors = std::pair<float, float>;
 
 /**\brief affine transformation matrix
@@ -104,8 +118,8 @@ inline ScaleFactors getScaleFactors(const Matrix &mat) {
   std::pair<float, float> xVec{mat.a[0][0], mat.a[1][0]};
   std::pair<float, float> yVec{mat.a[0][1], mat.a[1][1]};
 
-  return {std::sqrt(std::pow(xVec.first, 2) + std::pow(xVec.second, 2)),
-          std::sqrt(std::pow(yVec.first, 2) + std::pow(yVec.second, 2))};
+  return {std::sqrt(xVec.first * xVec.first + xVec.second * xVec.second),
+          std::sqrt(yVec.first * yVec.first + yVec.second * yVec.second)};
 }
 
 inline float getRotation(const Matrix &mat) {
@@ -114,55 +128,6 @@ inline float getRotation(const Matrix &mat) {
   float cosAngl           = mat.a[0][0] / xFactor;
   return std::atan2(-sinAngl, cosAngl);
 }
-
-/**\brief similar to Box, but provide rotating
- *
- * \note if you not need rotation the highly recomended to use Box
- */
-class Rect final {
-public:
-  /**\param anchor relative to minCorner
-   *
-   * \param angle in radians
-   */
-  Rect(Point minCorner, Size size, float angle, Point anchor = {0, 0});
-
-  explicit Rect(Box box);
-
-  /**\brief move the Rect on vector vec
-   */
-  void  moveOn(Point vec) noexcept;
-  void  setMinCorner(Point minCorner) noexcept;
-  Point getMinCorner() const noexcept;
-
-  void setSize(Size size) noexcept;
-  Size size() const noexcept;
-
-  /**\param anchor relative to minCorner
-   *
-   * \param angle in radians
-   */
-  void rotate(float angle, Point anchor = {0, 0}) noexcept;
-
-  /**\param anchor relative to minCorner
-   *
-   * \param angle in radians
-   */
-  void setRotation(float angle, Point anchor = {0, 0}) noexcept;
-
-  /**\return angle in radians
-   */
-  float getRotation() const noexcept;
-
-  void   setMatrix(Matrix mat) noexcept;
-  Matrix getMatrix() const noexcept;
-
-  operator Ring() const noexcept;
-
-private:
-  Matrix matrix_;
-  Size   size_;
-};
 } // namespace svc
 
 // add point traits for Point_
@@ -228,3 +193,265 @@ struct vec_traits<svc::Point_<AritmeticType>> {
   }
 };
 } // namespace boost::qvm
+
+namespace svc {
+/**\brief rotation and scale factors of affine transformation. Getting them
+ * from a transformation requires sqrt and atan2, so objects, which often
+ * return their rotation, keep the decomposition next to the transformation
+ *
+ * \see decompose
+ */
+struct Decomposition final {
+  /// in radians, not normalized
+  float angle;
+  float sinAngle;
+  float cosAngle;
+
+  ScaleFactors scaleFactors;
+
+  static constexpr Decomposition identity() noexcept {
+    return Decomposition{0, 0, 1, {1, 1}};
+  }
+
+  /**\param angle in radians
+   */
+  static Decomposition rotation(float angle) noexcept {
+    return Decomposition{angle, std::sin(angle), std::cos(angle), {1, 1}};
+  }
+};
+
+/**\brief affine transformation in compact form: first two rows of Matrix
+ * (last row of affine Matrix always is {0, 0, 1}). So it is 3x2 matrix
+ * (columnsXrows), where last column is translation
+ *
+ * \note like Point, the Affine is not initialized by default konstructor, use
+ * `Affine::identity()`
+ *
+ * \see toAffine, toMatrix
+ */
+struct Affine final {
+  float a[2][3];
+
+  static constexpr Affine identity() noexcept {
+    return Affine{{{1, 0, 0}, {0, 1, 0}}};
+  }
+
+  static Affine translation(Point pos) noexcept {
+    return Affine{{{1, 0, pos.x()}, {0, 1, pos.y()}}};
+  }
+
+  /**\param angle in radians, same as `bq::rotz_mat<3>(angle)`
+   */
+  static Affine rotation(float angle) noexcept {
+    return rotation(Decomposition::rotation(angle), Point{0, 0});
+  }
+
+  static constexpr Affine scale(float xFactor, float yFactor) noexcept {
+    return Affine{{{xFactor, 0, 0}, {0, yFactor, 0}}};
+  }
+
+  /**\return same transformation as `translation(anchor) * rotation(angle) *
+   * translation(-anchor)`
+   */
+  static Affine rotation(float angle, Point anchor) noexcept {
+    return rotation(Decomposition::rotation(angle), anchor);
+  }
+
+  /**\brief same as previous, but sin and cos are taken from the
+   * decomposition. Scale factors of the decomposition are ignored
+   */
+  static Affine rotation(const Decomposition &decomposition,
+                         Point                anchor) noexcept {
+    float  sinAngl = decomposition.sinAngle;
+    float  cosAngl = decomposition.cosAngle;
+    Affine retval{{{cosAngl, -sinAngl, 0}, {sinAngl, cosAngl, 0}}};
+    retval.a[0][2] =
+        anchor.x() - retval.a[0][0] * anchor.x() - retval.a[0][1] * anchor.y();
+    retval.a[1][2] =
+        anchor.y() - retval.a[1][0] * anchor.x() - retval.a[1][1] * anchor.y();
+    return retval;
+  }
+
+  inline Point getTranslation() const noexcept {
+    return Point{a[0][2], a[1][2]};
+  }
+
+  inline void setTranslation(Point pos) noexcept {
+    a[0][2] = pos.x();
+    a[1][2] = pos.y();
+  }
+};
+
+inline Affine toAffine(const Matrix &mat) noexcept {
+  return Affine{{{mat.a[0][0], mat.a[0][1], mat.a[0][2]},
+                 {mat.a[1][0], mat.a[1][1], mat.a[1][2]}}};
+}
+
+inline Matrix toMatrix(const Affine &aff) noexcept {
+  return Matrix{{{aff.a[0][0], aff.a[0][1], aff.a[0][2]},
+                 {aff.a[1][0], aff.a[1][1], aff.a[1][2]},
+                 {0, 0, 1}}};
+}
+
+/**\return composition of transformations: `(lhs * rhs)(p) == lhs(rhs(p))`,
+ * same as multiplication of matrices
+ */
+inline Affine operator*(const Affine &lhs, const Affine &rhs) noexcept {
+  Affine retval;
+  for (int r = 0; r < 2; ++r) {
+    retval.a[r][0] = lhs.a[r][0] * rhs.a[0][0] + lhs.a[r][1] * rhs.a[1][0];
+    retval.a[r][1] = lhs.a[r][0] * rhs.a[0][1] + lhs.a[r][1] * rhs.a[1][1];
+    retval.a[r][2] = lhs.a[r][0] * rhs.a[0][2] + lhs.a[r][1] * rhs.a[1][2] +
+                     lhs.a[r][2];
+  }
+  return retval;
+}
+
+inline Affine &operator*=(Affine &lhs, const Affine &rhs) noexcept {
+  lhs = lhs * rhs;
+  return lhs;
+}
+
+/**\return inverse transformation. Result is undefined if the transformation is
+ * degenerate (has zero scale)
+ */
+inline Affine inverse(const Affine &aff) noexcept {
+  float det = aff.a[0][0] * aff.a[1][1] - aff.a[0][1] * aff.a[1][0];
+
+  Affine retval;
+  retval.a[0][0] = aff.a[1][1] / det;
+  retval.a[0][1] = -aff.a[0][1] / det;
+  retval.a[1][0] = -aff.a[1][0] / det;
+  retval.a[1][1] = aff.a[0][0] / det;
+  retval.a[0][2] =
+      -(retval.a[0][0] * aff.a[0][2] + retval.a[0][1] * aff.a[1][2]);
+  retval.a[1][2] =
+      -(retval.a[1][0] * aff.a[0][2] + retval.a[1][1] * aff.a[1][2]);
+  return retval;
+}
+
+inline Point transformPoint(const Affine &aff, Point point) noexcept {
+  return Point{aff.a[0][0] * point.x() + aff.a[0][1] * point.y() + aff.a[0][2],
+               aff.a[1][0] * point.x() + aff.a[1][1] * point.y() + aff.a[1][2]};
+}
+
+/**\brief same as transformPoint, but without translation
+ */
+inline Point transformVector(const Affine &aff, Point vec) noexcept {
+  return Point{aff.a[0][0] * vec.x() + aff.a[0][1] * vec.y(),
+               aff.a[1][0] * vec.x() + aff.a[1][1] * vec.y()};
+}
+
+/**\return bounding box of the transformed box
+ */
+inline Box transformBox(const Affine &aff, const Box &box) noexcept {
+  float halfWidth  = (box.max_corner().x() - box.min_corner().x()) / 2;
+  float halfHeight = (box.max_corner().y() - box.min_corner().y()) / 2;
+
+  Point center = transformPoint(aff,
+                                Point{box.min_corner().x() + halfWidth,
+                                      box.min_corner().y() + halfHeight});
+
+  float xExtent =
+      std::abs(aff.a[0][0]) * halfWidth + std::abs(aff.a[0][1]) * halfHeight;
+  float yExtent =
+      std::abs(aff.a[1][0]) * halfWidth + std::abs(aff.a[1][1]) * halfHeight;
+
+  return Box{{center.x() - xExtent, center.y() - yExtent},
+             {center.x() + xExtent, center.y() + yExtent}};
+}
+
+inline ScaleFactors getScaleFactors(const Affine &aff) noexcept {
+  return {std::sqrt(aff.a[0][0] * aff.a[0][0] + aff.a[1][0] * aff.a[1][0]),
+          std::sqrt(aff.a[0][1] * aff.a[0][1] + aff.a[1][1] * aff.a[1][1])};
+}
+
+inline float getRotation(const Affine &aff) noexcept {
+  auto [xFactor, yFactor] = getScaleFactors(aff);
+  float sinAngl           = aff.a[0][1] / yFactor;
+  float cosAngl           = aff.a[0][0] / xFactor;
+  return std::atan2(-sinAngl, cosAngl);
+}
+
+/**\return rotation and scale factors of the transformation, angle is same as
+ * returned by getRotation
+ */
+inline Decomposition decompose(const Affine &aff) noexcept {
+  ScaleFactors factors = getScaleFactors(aff);
+  float        sinAngl = -aff.a[0][1] / factors.second;
+  float        cosAngl = aff.a[0][0] / factors.first;
+  return Decomposition{std::atan2(sinAngl, cosAngl), sinAngl, cosAngl, factors};
+}
+
+/**\brief similar to Box, but provide rotating
+ *
+ * \note if you not need rotation the highly recomended to use Box
+ */
+class Rect final {
+public:
+  /**\param anchor relative to minCorner
+   *
+   * \param angle in radians
+   */
+  Rect(Point minCorner, Size size, float angle, Point anchor = {0, 0});
+
+  /**\brief same as previous, but rotation is taken from the decomposition, so
+   * sin and cos are not computed. Scale factors of the decomposition are
+   * ignored
+   */
+  Rect(Point minCorner, Size size, const Decomposition &rotation);
+
+  explicit Rect(Box box);
+
+  /**\brief move the Rect on vector vec
+   */
+  void  moveOn(Point vec) noexcept;
+  void  setMinCorner(Point minCorner) noexcept;
+  Point getMinCorner() const noexcept;
+
+  void setSize(Size size) noexcept;
+  Size size() const noexcept;
+
+  /**\param anchor relative to minCorner
+   *
+   * \param angle in radians
+   */
+  void rotate(float angle, Point anchor = {0, 0}) noexcept;
+
+  /**\param anchor relative to minCorner
+   *
+   * \param angle in radians
+   */
+  void setRotation(float angle, Point anchor = {0, 0}) noexcept;
+
+  /**\return angle in radians
+   */
+  float getRotation() const noexcept;
+
+  /**\return rotation of the Rect with sin and cos of the angle. Scale factors
+   * are not 1 only if scaled transformation was set
+   */
+  const Decomposition &getDecomposition() const noexcept;
+
+  void   setMatrix(Matrix mat) noexcept;
+  Matrix getMatrix() const noexcept;
+
+  void   setTransform(const Affine &transform) noexcept;
+  Affine getTransform() const noexcept;
+
+  operator Ring() const noexcept;
+
+  /**\brief same as conversion to Ring, but the result is written to the
+   * ring, so its memory can be reused
+   */
+  void toRing(Ring &ring) const noexcept;
+
+private:
+  Affine transform_;
+
+  /// cache of decomposition of transform_, translation doesn't change it
+  Decomposition decomposition_;
+
+  Size size_;
+};
+} // namespace svc
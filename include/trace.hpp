@@ -0,0 +1,280 @@
+// trace.hpp
+/**\file
+ * Lightweight tracing by scoped spans. Spans are collected only if macro
+ * `TRACING` is defined, otherwise all tracing macroses are empty and tracing
+ * has no cost at all.
+ *
+ * - `TRACE_SCOPE(name)` - span from the macro to end of current scope. `name`
+ *   must be a string literal (or other string with static storage duration),
+ *   because only pointer to it is stored
+ * - `TRACE_FUNCTION()` - same as `TRACE_SCOPE(__func__)`
+ * - `TRACE_DUMP(fileName)` - write all collected spans to the file in Chrome
+ *   trace JSON format. The file can be opened by `chrome://tracing` or
+ *   Perfetto UI
+ *
+ * Every thread writes spans to own fixed-size buffer without any locks. If
+ * the buffer is full, then new spans of the thread are dropped (count of
+ * dropped spans is written to output). You can set size of the buffer (count
+ * of spans) by `TRACE_BUFFER_SIZE` macro.
+ *
+ * \warning buffers of threads are never released, so tracing is intended for
+ * investigations, not for permanent usage
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <string>
+
+#ifndef TRACE_BUFFER_SIZE
+#  define TRACE_BUFFER_SIZE (1 << 16)
+#endif
+
+namespace trace {
+using Clock = std::chrono::steady_clock;
+
+struct Span {
+  const char *name;
+
+  /// nanoseconds from start of tracing
+  uint64_t start;
+  uint64_t duration;
+};
+
+/**\brief buffer of spans for one thread. Only owner thread appends spans to
+ * the buffer, and any other thread can read appended spans: size of the buffer
+ * is published by release store after writing the span
+ */
+class ThreadBuffer {
+public:
+  explicit ThreadBuffer(uint32_t threadId) noexcept
+      : threadId_{threadId}
+      , size_{0}
+      , dropped_{0}
+      , next_{nullptr} {
+  }
+
+  /**\note can be called only by owner thread
+   */
+  void append(Span span) noexcept {
+    size_t size = size_.load(std::memory_order_relaxed);
+    if (size == TRACE_BUFFER_SIZE) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    spans_[size] = span;
+    size_.store(size + 1, std::memory_order_release);
+  }
+
+  uint32_t threadId() const noexcept {
+    return threadId_;
+  }
+
+  size_t size() const noexcept {
+    return size_.load(std::memory_order_acquire);
+  }
+
+  size_t dropped() const noexcept {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+  const Span &operator[](size_t i) const noexcept {
+    return spans_[i];
+  }
+
+private:
+  friend class Tracer;
+
+  uint32_t            threadId_;
+  std::atomic<size_t> size_;
+  std::atomic<size_t> dropped_;
+  ThreadBuffer *      next_;
+
+  Span spans_[TRACE_BUFFER_SIZE];
+};
+
+/**\brief registry of buffers of all threads
+ */
+class Tracer final {
+public:
+  static Tracer &get() noexcept {
+    static Tracer tracer;
+    return tracer;
+  }
+
+  /**\return nanoseconds from start of tracing
+   */
+  uint64_t now() const noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                                epoch_)
+        .count();
+  }
+
+  /**\return buffer of current thread. Buffer is created by first call in the
+   * thread
+   */
+  ThreadBuffer &getThreadBuffer() noexcept {
+    thread_local ThreadBuffer *buffer = nullptr;
+    if (buffer == nullptr) {
+      buffer = new ThreadBuffer{
+          nextThreadId_.fetch_add(1, std::memory_order_relaxed)};
+
+      // lock-free push to list of buffers
+      buffer->next_ = head_.load(std::memory_order_relaxed);
+      while (!head_.compare_exchange_weak(buffer->next_,
+                                          buffer,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed)) {
+      }
+    }
+    return *buffer;
+  }
+
+  /**\brief write all collected spans in Chrome trace JSON format. Can be
+   * called concurrently with tracing, in this case spans appended after
+   * calling are not written
+   */
+  void write(std::ostream &out) const {
+    out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+
+    bool first = true;
+    for (const ThreadBuffer *buffer = head_.load(std::memory_order_acquire);
+         buffer;
+         buffer = buffer->next_) {
+      size_t size = buffer->size();
+      for (size_t i = 0; i < size; ++i) {
+        const Span &span = (*buffer)[i];
+
+        out << (first ? "\n" : ",\n");
+        out << "{\"name\": \"";
+        writeEscaped(out, span.name);
+        out << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+            << buffer->threadId() << ", \"ts\": ";
+        writeMicroseconds(out, span.start);
+        out << ", \"dur\": ";
+        writeMicroseconds(out, span.duration);
+        out << "}";
+        first = false;
+      }
+
+      if (size_t dropped = buffer->dropped()) {
+        out << (first ? "\n" : ",\n");
+        out << "{\"name\": \"dropped spans\", \"ph\": \"C\", \"pid\": 1, "
+               "\"tid\": "
+            << buffer->threadId() << ", \"ts\": 0, \"args\": {\"dropped\": "
+            << dropped << "}}";
+        first = false;
+      }
+    }
+
+    out << "\n]}\n";
+  }
+
+  /**\brief write all collected spans to the file
+   *
+   * \return false if the file can not be written
+   */
+  bool dump(const std::string &fileName) const {
+    std::ofstream fout{fileName, std::ios::out | std::ios::trunc};
+    if (fout.is_open() == false) {
+      return false;
+    }
+
+    this->write(fout);
+    fout.close();
+
+    return fout.fail() == false;
+  }
+
+private:
+  // XXX the tracer doesn't release buffers deliberately: thread_local pointers
+  // to them are not cleared, and spans of threads (or static objects), which
+  // finish after destruction of the tracer, are still written to the buffers
+  Tracer() noexcept
+      : epoch_{Clock::now()}
+      , head_{nullptr}
+      , nextThreadId_{1} {
+  }
+
+  Tracer(const Tracer &) = delete;
+  Tracer(Tracer &&)      = delete;
+
+  /// control characters are written as `\u00XX`, because JSON doesn't allow
+  /// them in strings
+  static void writeEscaped(std::ostream &out, const char *str) {
+    const char hex[] = "0123456789abcdef";
+    for (; *str; ++str) {
+      unsigned char c = *str;
+      if (c == '"' || c == '\\') {
+        out << '\\' << *str;
+      } else if (c < 0x20) {
+        out << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+      } else {
+        out << *str;
+      }
+    }
+  }
+
+  /// Chrome trace uses microseconds, so nanoseconds are written as fraction
+  static void writeMicroseconds(std::ostream &out, uint64_t nanoseconds) {
+    uint64_t fraction = nanoseconds % 1000;
+    out << nanoseconds / 1000 << '.' << fraction / 100 << fraction / 10 % 10
+        << fraction % 10;
+  }
+
+private:
+  Clock::time_point           epoch_;
+  std::atomic<ThreadBuffer *> head_;
+  std::atomic<uint32_t>       nextThreadId_;
+};
+
+/**\brief RAII span: appends span to buffer of current thread on destruction
+ */
+class Scope final {
+public:
+  explicit Scope(const char *name) noexcept
+      : name_{name}
+      , start_{Tracer::get().now()} {
+  }
+
+  ~Scope() noexcept {
+    Tracer &tracer = Tracer::get();
+    tracer.getThreadBuffer().append(
+        Span{name_, start_, tracer.now() - start_});
+  }
+
+  Scope(const Scope &) = delete;
+  Scope(Scope &&)      = delete;
+
+private:
+  const char *name_;
+  uint64_t    start_;
+};
+} // namespace trace
+
+#ifdef TRACING
+
+#  define TRACE_CONCAT_IMP(first, second) first##second
+#  define TRACE_CONCAT(first, second)     TRACE_CONCAT_IMP(first, second)
+
+#  define TRACE_SCOPE(name)                                                    \
+    trace::Scope TRACE_CONCAT(traceScope, __LINE__) {                          \
+      name                                                                     \
+    }
+
+#  define TRACE_FUNCTION() TRACE_SCOPE(__func__)
+
+#  define TRACE_DUMP(fileName) trace::Tracer::get().dump(fileName)
+
+#else
+
+#  define TRACE_SCOPE(name)
+#  define TRACE_FUNCTION()
+#  define TRACE_DUMP(fileName) false
+
+#endif
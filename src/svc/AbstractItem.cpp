@@ -4,10 +4,7 @@
 #include "asserts.hpp"
 #include "logs.hpp"
 #include "svc/Scene.hpp"
-#include <boost/qvm/map_mat_vec.hpp>
-#include <boost/qvm/map_vec_mat.hpp>
-#include <boost/qvm/mat_operations.hpp>
-#include <boost/qvm/swizzle.hpp>
+#include "trace.hpp"
 
 namespace svc {
 using ItemPtr  = ItemPtr;
@@ -16,84 +13,128 @@ using Children = AbstractItem::Children;
 class AbstractItemImp {
 public:
   AbstractItemImp() noexcept
-      : matrix_{} {
-    matrix_ = bq::diag_mat(Vector{1, 1, 1});
+      : transform_{Affine::identity()}
+      , sceneTransform_{Affine::identity()}
+      , sceneDecomposition_{Decomposition::identity()}
+      , sceneTransformDirty_{true}
+      , sceneDecompositionDirty_{false} {
   }
 
   ~AbstractItemImp() noexcept {
   }
 
   inline void moveOn(Point diff) noexcept {
-    matrix_ *= bq::translation_mat(diff);
+    transform_ *= Affine::translation(diff);
   }
 
   inline void setPos(Point pos) noexcept {
-    bq::translation(matrix_) = pos;
+    transform_.setTranslation(pos);
   }
 
   inline Point getPos() const noexcept {
-    Point pos = bq::translation(matrix_);
-    return pos;
+    return transform_.getTranslation();
   }
 
-  inline Matrix getMatrix() const noexcept {
-    return matrix_;
+  inline const Affine &getTransform() const noexcept {
+    return transform_;
   }
 
-  inline void setMatrix(Matrix matrix) noexcept {
-    matrix_ = std::move(matrix);
+  inline void setTransform(const Affine &transform) noexcept {
+    transform_ = transform;
   }
 
   inline float getRotation() const noexcept {
-    float angle = svc::getRotation(matrix_);
+    float angle = svc::getRotation(transform_);
     return angle;
   }
 
   inline void rotate(float angle, Point anchor) noexcept {
-    Matrix translationMat = bq::translation_mat(anchor);
+    transform_ *= Affine::rotation(angle, anchor);
+  }
 
-    Matrix rotationMat = translationMat;
-    rotationMat *= bq::rotz_mat<3>(angle);
-    rotationMat *= bq::inverse(translationMat);
+  inline void setRotation(float angle, Point anchor) noexcept {
+    transform_ = Affine::translation(transform_.getTranslation()) *
+                 Affine::rotation(angle, anchor);
+  }
 
-    matrix_ *= rotationMat;
+  inline bool isSceneTransformDirty() const noexcept {
+    return sceneTransformDirty_;
   }
 
-  inline void setRotation(float angle, Point anchor) noexcept {
-    Matrix translationMat = bq::translation_mat(anchor);
+  /**\return true if the cache was valid before the call
+   */
+  inline bool invalidateSceneTransform() noexcept {
+    bool wasValid        = !sceneTransformDirty_;
+    sceneTransformDirty_ = true;
+    return wasValid;
+  }
 
-    Matrix resultMat = bq::translation_mat(bq::translation(matrix_));
-    resultMat *= translationMat;
-    resultMat *= bq::rotz_mat<3>(angle);
-    resultMat *= bq::inverse(translationMat);
+  inline const Affine &getSceneTransform() const noexcept {
+    return sceneTransform_;
+  }
 
-    matrix_ = std::move(resultMat);
+  inline void setSceneTransform(const Affine &sceneTransform) const noexcept {
+    // XXX moving doesn't change rotation and scale, so the decomposition is
+    // invalidated only if linear part of the transformation was changed
+    if (sceneTransform.a[0][0] != sceneTransform_.a[0][0] ||
+        sceneTransform.a[0][1] != sceneTransform_.a[0][1] ||
+        sceneTransform.a[1][0] != sceneTransform_.a[1][0] ||
+        sceneTransform.a[1][1] != sceneTransform_.a[1][1]) {
+      sceneDecompositionDirty_ = true;
+    }
+
+    sceneTransform_      = sceneTransform;
+    sceneTransformDirty_ = false;
+  }
+
+  /**\warning the cache of Scene transformation must be valid
+   */
+  inline const Decomposition &getSceneDecomposition() const noexcept {
+    if (sceneDecompositionDirty_) {
+      sceneDecomposition_      = decompose(sceneTransform_);
+      sceneDecompositionDirty_ = false;
+    }
+    return sceneDecomposition_;
   }
 
 private:
   /**\brief store information relatively to parent (if Item don't has any parent
    * then the information is relative to Scene)
    */
-  Matrix matrix_;
+  Affine transform_;
+
+  /**\brief cache of product of transformations of all parents and the Item.
+   *
+   * \note if the cache is dirty, then caches of all children are also dirty,
+   * so invalidation of subtree can stop on first dirty Item
+   */
+  mutable Affine sceneTransform_;
+
+  /// cache of decomposition of sceneTransform_
+  mutable Decomposition sceneDecomposition_;
+
+  mutable bool sceneTransformDirty_;
+  mutable bool sceneDecompositionDirty_;
 };
 
 AbstractItem::AbstractItem() noexcept
-    : imp_{new AbstractItemImp{}}
+    : imp_{}
     , scene_{nullptr}
-    , parent_{nullptr} {
+    , parent_{nullptr}
+    , position_{} {
 }
 
 AbstractItem::~AbstractItem() noexcept {
-  Children children = this->children_;
-  std::for_each(children.begin(), children.end(), [this](ItemPtr &child) {
-    this->removeChild(child.get());
-  });
+  TRACE_SCOPE("AbstractItem::~AbstractItem");
 
-  delete imp_;
+  // XXX the child must be alive until end of removing
+  while (children_.empty() == false) {
+    ItemPtr child = children_.front();
+    this->tryRemoveChild(child.get());
+  }
 
 #ifndef NDEBUG
   children_.clear();
-  imp_    = nullptr;
   scene_  = nullptr;
   parent_ = nullptr;
 #endif
@@ -108,13 +149,12 @@ Point AbstractItem::getPos() const noexcept {
 }
 
 Point AbstractItem::getScenePos() const noexcept {
-  Matrix     matrix = this->getSceneMatrix();
-  svc::Point pos    = bq::translation(matrix);
-  return pos;
+  return this->getSceneTransform().getTranslation();
 }
 
 void AbstractItem::moveOn(Point diff) {
   imp_->moveOn(diff);
+  this->invalidateSceneMatrix();
 
   if (scene_) {
     scene_->updateItemPosition(this);
@@ -123,6 +163,7 @@ void AbstractItem::moveOn(Point diff) {
 
 void AbstractItem::setPos(Point pos) {
   imp_->setPos(pos);
+  this->invalidateSceneMatrix();
 
   if (scene_) {
     scene_->updateItemPosition(this);
@@ -130,16 +171,18 @@ void AbstractItem::setPos(Point pos) {
 }
 
 void AbstractItem::setScenePos(Point scenePos) {
+  TRACE_SCOPE("AbstractItem::setScenePos");
+
   // XXX because all information about position stores in koordinates relatively
   // to parent, we need transform the position from absolute koordinates to
   // relative
   if (parent_) {
-    Matrix      sceneMatrix = this->parent_->getSceneMatrix();
-    svc::Vector relativePos = bq::inverse(sceneMatrix) * bq::XY1(scenePos);
-    imp_->setPos(bq::XY(relativePos));
+    const Affine &parentTransform = this->parent_->getSceneTransform();
+    imp_->setPos(transformPoint(inverse(parentTransform), scenePos));
   } else {
     imp_->setPos(scenePos);
   }
+  this->invalidateSceneMatrix();
 
   if (scene_) {
     scene_->updateItemPosition(this);
@@ -154,26 +197,39 @@ Children AbstractItem::getChildren() const noexcept {
   return children_;
 }
 
+AbstractItem::ChildRange AbstractItem::getChildrenRange() const noexcept {
+  return ChildRange{children_.begin(), children_.end()};
+}
+
+AbstractItem::SubtreeRange AbstractItem::getSubtree() const noexcept {
+  return SubtreeRange{SubtreeIterator{this}, SubtreeIterator{}};
+}
+
 void AbstractItem::appendChild(ItemPtr &child) {
   if (child.get() == nullptr) {
     LOG_THROW(std::runtime_error, "can't append invalid child");
   }
 
+  TRACE_SCOPE("AbstractItem::appendChild");
+
+  // XXX if the child is moved between Items of the same Scene, then it stays
+  // in the Scene with its flags and boxes, so only hierarchy is changed
   if (AbstractItem *childParent = child->getParent()) {
-    childParent->removeChild(child.get());
+    if (scene_ && child->getScene() == scene_) {
+      childParent->unlinkChild(child.get());
+    } else {
+      childParent->removeChild(child.get());
+    }
   }
 
   // before append to childs we must change matrix of child for save its Scene
   // position
-  {
-    Matrix childMatrix    = child->imp_->getMatrix();
-    Matrix parentMatrix   = this->getSceneMatrix();
-    Matrix newChildMatrix = bq::inverse(parentMatrix) * childMatrix;
-    child->imp_->setMatrix(newChildMatrix);
-  }
+  child->imp_->setTransform(inverse(this->getSceneTransform()) *
+                            child->imp_->getTransform());
 
-  child->parent_ = this;
-  this->children_.emplace_back(child);
+  child->parent_   = this;
+  child->position_ = children_.emplace(children_.end(), child);
+  child->invalidateSceneMatrix();
 
   if (Scene *childScene = child->getScene(); scene_ && (childScene != scene_)) {
     scene_->appendItem(child);
@@ -183,41 +239,55 @@ void AbstractItem::appendChild(ItemPtr &child) {
 }
 
 void AbstractItem::removeChild(AbstractItem *child) {
-  if (child == nullptr || this != child->parent_) {
+  if (this->tryRemoveChild(child) != Status::Ok) {
     LOG_THROW(std::runtime_error, "child has different parent");
   }
+}
 
-  // at first we need change child, especially its matrix, because if the Item
-  // will be set to another parent (or set to Scene), we Item must save its
-  // Scene position
-  Matrix childSceneMatrix = child->getSceneMatrix();
-  child->parent_          = nullptr;
-
-  auto forRemove = std::find_if(children_.begin(),
-                                children_.end(),
-                                [child](const ItemPtr &item) {
-                                  if (child == item.get()) {
-                                    return true;
-                                  }
-                                  return false;
-                                });
-
-  DEBBUG_ASSERT(forRemove != children_.end(), "child not found");
+Status AbstractItem::tryRemoveChild(AbstractItem *child) {
+  if (child == nullptr) {
+    return Status::InvalidArgument;
+  }
+  if (this != child->parent_) {
+    return Status::NotFound;
+  }
 
-  children_.erase(forRemove);
+  TRACE_SCOPE("AbstractItem::removeChild");
 
-  child->imp_->setMatrix(std::move(childSceneMatrix));
+  // XXX the child can be owned only by the parent, so it must be alive until
+  // end of the function
+  ItemPtr holder = *child->position_;
+  this->unlinkChild(child);
 
   // XXX NOTE: use child Scene, because if child already removed from Scene,
   // then its Scene was set to nullptr. If you use parent Scene you can get
   // recursive call
   if (Scene *childScene = child->getScene()) {
-    childScene->removeItem(child);
+    childScene->tryRemoveItem(child);
   }
+
+  return Status::Ok;
+}
+
+void AbstractItem::unlinkChild(AbstractItem *child) noexcept {
+  // at first we need change child, especially its matrix, because if the Item
+  // will be set to another parent (or set to Scene), we Item must save its
+  // Scene position
+  Affine childSceneTransform = child->getSceneTransform();
+  child->parent_             = nullptr;
+
+  DEBBUG_ASSERT(child->position_->get() == child, "invalid child position");
+
+  children_.erase(child->position_);
+  child->position_ = Children::iterator{};
+
+  // XXX Scene matrix of the child is not changed, so its cache is still valid
+  child->imp_->setTransform(childSceneTransform);
 }
 
 void AbstractItem::setMatrix(Matrix matrix) {
-  imp_->setMatrix(std::move(matrix));
+  imp_->setTransform(toAffine(matrix));
+  this->invalidateSceneMatrix();
 
   if (scene_) {
     scene_->updateItemPosition(this);
@@ -225,18 +295,38 @@ void AbstractItem::setMatrix(Matrix matrix) {
 }
 
 Matrix AbstractItem::getMatrix() const noexcept {
-  return imp_->getMatrix();
+  return toMatrix(imp_->getTransform());
 }
 
 Matrix AbstractItem::getSceneMatrix() const noexcept {
-  Matrix matrix = imp_->getMatrix();
+  return toMatrix(this->getSceneTransform());
+}
 
-  if (this->parent_) {
-    Matrix parentMatrix = this->parent_->getSceneMatrix();
-    matrix              = parentMatrix * matrix;
+const Affine &AbstractItem::getTransform() const noexcept {
+  return imp_->getTransform();
+}
+
+const Affine &AbstractItem::getSceneTransform() const noexcept {
+  if (imp_->isSceneTransformDirty()) {
+    if (this->parent_) {
+      imp_->setSceneTransform(this->parent_->getSceneTransform() *
+                              imp_->getTransform());
+    } else {
+      imp_->setSceneTransform(imp_->getTransform());
+    }
+  }
+
+  return imp_->getSceneTransform();
+}
+
+void AbstractItem::invalidateSceneMatrix() noexcept {
+  if (imp_->invalidateSceneTransform() == false) {
+    return;
   }
 
-  return matrix;
+  for (ItemPtr &child : children_) {
+    child->invalidateSceneMatrix();
+  }
 }
 
 float AbstractItem::getRotation() const noexcept {
@@ -245,48 +335,52 @@ float AbstractItem::getRotation() const noexcept {
 }
 
 float AbstractItem::getSceneRotation() const noexcept {
-  Matrix mat   = this->getSceneMatrix();
-  float  angle = svc::getRotation(mat);
+  // XXX the decomposition is valid only for valid Scene transformation
+  this->getSceneTransform();
+
+  float angle = imp_->getSceneDecomposition().angle;
   return NORM_RADIANS(angle);
 }
 
 void AbstractItem::rotate(float angle, Point anchor) {
   imp_->rotate(angle, anchor);
+  this->invalidateSceneMatrix();
 
   // XXX if anchor is default, then we not need update position, becuase
   // position of the Item didn't change
   if (anchor != Point{0, 0} && scene_) {
     scene_->updateItemPosition(this);
+  } else if (scene_) {
+    scene_->updateItemTransform(this);
   }
 }
 
 void AbstractItem::setRotation(float angle, Point anchor) {
   imp_->setRotation(angle, anchor);
+  this->invalidateSceneMatrix();
 
   if (anchor != Point{0, 0} && scene_) {
     scene_->updateItemPosition(this);
+  } else if (scene_) {
+    scene_->updateItemTransform(this);
   }
 }
 
 void AbstractItem::setSceneRotation(float angle, Point anchor) {
-  Matrix translationMat = bq::translation_mat(anchor);
-
-  Matrix currentMat = imp_->getMatrix();
-
-  Matrix resultMat = bq::translation_mat(bq::translation(currentMat));
-  resultMat *= translationMat;
-  resultMat *= bq::rotz_mat<3>(angle);
-  resultMat *= bq::inverse(translationMat);
+  Affine result = Affine::translation(imp_->getTransform().getTranslation()) *
+                  Affine::rotation(angle, anchor);
 
   if (this->parent_) {
-    Matrix parentMatrix = this->parent_->getSceneMatrix();
-    resultMat *= bq::inverse(parentMatrix);
+    result *= inverse(this->parent_->getSceneTransform());
   }
 
-  imp_->setMatrix(std::move(resultMat));
+  imp_->setTransform(result);
+  this->invalidateSceneMatrix();
 
   if (anchor != Point{0, 0} && scene_) {
     scene_->updateItemPosition(this);
+  } else if (scene_) {
+    scene_->updateItemTransform(this);
   }
 }
 
@@ -1,80 +1,101 @@
 // AbstractView.cpp
 
 #include "svc/AbstractView.hpp"
-#include <boost/qvm/map_vec_mat.hpp>
-#include <boost/qvm/swizzle.hpp>
 #include <svc/AbstractItem.hpp>
+#include <svc/BatchTransform.hpp>
 #include <svc/Scene.hpp>
+#include <trace.hpp>
 
 namespace svc {
 class AbstractViewImp {
 public:
-  AbstractViewImp() noexcept {
-    matrix_ = bq::translation_mat(svc::Point{0, 0});
+  AbstractViewImp() noexcept
+      : transform_{Affine::identity()}
+      , decomposition_{Decomposition::identity()} {
   }
 
-  void setMatrix(Matrix mat) noexcept {
-    matrix_ = std::move(mat);
+  void setTransform(const Affine &transform) noexcept {
+    transform_     = transform;
+    decomposition_ = decompose(transform_);
   }
 
-  Matrix getMatrix() const noexcept {
-    return matrix_;
+  const Affine &getTransform() const noexcept {
+    return transform_;
   }
 
   inline void moveOn(Point diff) noexcept {
-    matrix_ *= bq::translation_mat(diff);
+    transform_ *= Affine::translation(diff);
   }
 
   inline void rotate(float angle, Point anchor) noexcept {
-    Matrix translationMat = bq::translation_mat(anchor);
-
-    Matrix rotationMat = translationMat;
-    rotationMat *= bq::rotz_mat<3>(angle);
-    rotationMat *= bq::inverse(translationMat);
-
-    matrix_ *= rotationMat;
+    this->setTransform(transform_ * Affine::rotation(angle, anchor));
   }
 
-  inline float getRotation() const noexcept {
-    float angle = svc::getRotation(matrix_);
-    return angle;
+  /**\return rotation and scale factors of the transformation. Moving doesn't
+   * change them, so they are recomputed only after rotating or scaling
+   */
+  inline const Decomposition &getDecomposition() const noexcept {
+    return decomposition_;
   }
 
   inline void scale(ScaleFactors factors, Point anchor) noexcept {
     auto [xFactor, yFactor] = factors;
 
-    Matrix translationMat = bq::translation_mat(anchor);
+    this->setTransform(transform_ * Affine::translation(anchor) *
+                       Affine::scale(xFactor, yFactor) *
+                       Affine::translation(Point{-anchor.x(), -anchor.y()}));
+  }
 
-    Matrix scaleMatrix = translationMat;
-    scaleMatrix *= bq::diag_mat(Vector{xFactor, yFactor, 1});
-    scaleMatrix *= bq::inverse(translationMat);
+  /**\brief convert View point to Scene point
+   */
+  inline Point map(Point viewPoint) const noexcept {
+    return transformPoint(transform_, viewPoint);
+  }
 
-    matrix_ *= scaleMatrix;
+  inline void map(const Point *viewPoints,
+                  Point *      scenePoints,
+                  size_t       count) const noexcept {
+    transformPoints(transform_, viewPoints, scenePoints, count);
   }
 
-  inline ScaleFactors getScaleFactors() const noexcept {
-    return svc::getScaleFactors(matrix_);
+  /**\return buffer for results of queries, which reused between calls of
+   * accept, so culling doesn't allocate memory after first frames
+   */
+  inline ItemBuffer &getBuffer() noexcept {
+    return buffer_;
   }
 
-  /**\brief convert View point to Scene point
+  /**\return same as getBuffer, but the buffer holds Items, so visitors can
+   * remove Items from the Scene
    */
-  inline Point map(Point viewPoint) const noexcept {
-    Vector retval = matrix_ * bq::XY1(viewPoint);
-    return bq::XY(retval);
+  inline SharedItemBuffer &getSharedBuffer() noexcept {
+    return sharedBuffer_;
+  }
+
+  /**\return Ring of the rect. Memory of the Ring is reused between calls, so
+   * culling doesn't allocate it every frame
+   */
+  inline const Ring &getRing(const Rect &rect) noexcept {
+    rect.toRing(ring_);
+    return ring_;
   }
 
 private:
-  /**\brief matrix which map View koordinates to Scene Koordinates
+  /**\brief transformation which map View koordinates to Scene Koordinates
    */
-  Matrix matrix_;
+  Affine        transform_;
+  Decomposition decomposition_;
+
+  ItemBuffer       buffer_;
+  SharedItemBuffer sharedBuffer_;
+  Ring             ring_;
 };
 
 AbstractView::AbstractView() noexcept
-    : imp_{new AbstractViewImp} {
+    : imp_{} {
 }
 
 AbstractView::~AbstractView() noexcept {
-  delete imp_;
 }
 
 void AbstractView::setScene(ScenePtr scene) noexcept {
@@ -86,7 +107,7 @@ ScenePtr AbstractView::getScene() const noexcept {
 }
 
 void AbstractView::setSceneRect(Rect sceneRect) noexcept {
-  Matrix rectMatrix = sceneRect.getMatrix();
+  Affine rectTransform = sceneRect.getTransform();
 
   // so, we get matrix, but it is without scale. Scale is ratio sizes of rect
   // and view and scene
@@ -96,22 +117,22 @@ void AbstractView::setSceneRect(Rect sceneRect) noexcept {
   float xFactor = rectSize.width() / viewSize.width();
   float yFactor = rectSize.height() / viewSize.height();
 
-  Matrix scaleMatrix = bq::diag_mat(Vector{xFactor, yFactor, 1});
-  rectMatrix *= scaleMatrix;
+  rectTransform *= Affine::scale(xFactor, yFactor);
 
-  imp_->setMatrix(std::move(rectMatrix));
+  imp_->setTransform(rectTransform);
 }
 
 Rect AbstractView::getSceneRect() const noexcept {
   Size viewSize = this->size();
 
-  Point minCorner         = imp_->map(Point{0, 0});
-  float angle             = imp_->getRotation();
-  auto [xFactor, yFactor] = imp_->getScaleFactors();
+  // XXX minCorner is mapped {0, 0}, so it is just translation
+  Point                minCorner     = imp_->getTransform().getTranslation();
+  const Decomposition &decomposition = imp_->getDecomposition();
+  auto [xFactor, yFactor]            = decomposition.scaleFactors;
 
   Size rectSize = {viewSize.width() * xFactor, viewSize.height() * yFactor};
 
-  return Rect{minCorner, rectSize, angle};
+  return Rect{minCorner, rectSize, decomposition};
 }
 
 void AbstractView::rotateSceneRect(float angle, svc::Point anchor) noexcept {
@@ -127,23 +148,53 @@ void AbstractView::scaleSceneRect(ScaleFactors factors, Point anchor) noexcept {
 }
 
 Matrix AbstractView::getSceneTransformMatrix() const noexcept {
-  return imp_->getMatrix();
+  return toMatrix(imp_->getTransform());
 }
 
 void AbstractView::setSceneTransformMatrix(Matrix mat) noexcept {
-  imp_->setMatrix(std::move(mat));
+  imp_->setTransform(toAffine(mat));
 }
 
 Point AbstractView::mapToScene(Point viewPoint) const noexcept {
   return imp_->map(viewPoint);
 }
 
+void AbstractView::mapToScene(const Point *viewPoints,
+                              Point *      scenePoints,
+                              size_t       count) const noexcept {
+  imp_->map(viewPoints, scenePoints, count);
+}
+
 void AbstractView::accept(AbstractVisitor *visitor) {
+  TRACE_SCOPE("AbstractView::accept");
+
   if (scene_) {
-    ItemList list = scene_->query(this->getSceneRect());
-    std::for_each(list.begin(), list.end(), [visitor](ItemPtr &item) {
+    SharedItemBuffer &buffer = imp_->getSharedBuffer();
+    scene_->query(imp_->getRing(this->getSceneRect()), buffer);
+
+    TRACE_SCOPE("AbstractView::accept.dispatch");
+    for (const ItemPtr &item : buffer) {
       item->accept(visitor);
-    });
+    }
+
+    // XXX the buffer keeps its memory, but must not hold Items until next call
+    buffer.clear();
+  }
+}
+
+void AbstractView::accept(AbstractVisitor *    visitor,
+                          const SceneSnapshot &snapshot) {
+  TRACE_SCOPE("AbstractView::accept");
+
+  ItemBuffer &buffer = imp_->getBuffer();
+  {
+    TRACE_SCOPE("AbstractView::accept.query");
+    snapshot.query(imp_->getRing(this->getSceneRect()), buffer);
+  }
+
+  TRACE_SCOPE("AbstractView::accept.dispatch");
+  for (AbstractItem *item : buffer) {
+    item->accept(visitor);
   }
 }
 } // namespace svc
@@ -0,0 +1,416 @@
+// BatchTransform.cpp
+
+#include "svc/BatchTransform.hpp"
+#include <atomic>
+
+// XXX vectorized kernels are compiled for x86 by target attributes, so the
+// library can be built without -msse2 or -mavx2 flags
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define SVC_BATCH_X86
+#  include <immintrin.h>
+#  define SVC_TARGET_SSE2 __attribute__((target("sse2")))
+#  define SVC_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace svc {
+static_assert(sizeof(Point) == 2 * sizeof(float), "Point must be two floats");
+static_assert(sizeof(Box) == 4 * sizeof(float), "Box must be two Points");
+static_assert(sizeof(Affine) == 6 * sizeof(float), "Affine must be 6 floats");
+
+/**\brief implementation of all batch functions
+ */
+struct BatchKernels {
+  BatchKernel kernel;
+
+  void (*transformPoints)(const Affine &aff,
+                          const Point * points,
+                          Point *       out,
+                          size_t        count) noexcept;
+
+  void (*transformBoxes)(const Affine *transforms,
+                         const Box *   boxes,
+                         Box *         out,
+                         size_t        count) noexcept;
+
+  void (*composeTransforms)(const Affine *lhs,
+                            const Affine *rhs,
+                            Affine *      out,
+                            size_t        count) noexcept;
+};
+
+static void transformPointsScalar(const Affine &aff,
+                                  const Point * points,
+                                  Point *       out,
+                                  size_t        count) noexcept {
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = transformPoint(aff, points[i]);
+  }
+}
+
+static void transformBoxesScalar(const Affine *transforms,
+                                 const Box *   boxes,
+                                 Box *         out,
+                                 size_t        count) noexcept {
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = transformBox(transforms[i], boxes[i]);
+  }
+}
+
+static void composeTransformsScalar(const Affine *lhs,
+                                    const Affine *rhs,
+                                    Affine *      out,
+                                    size_t        count) noexcept {
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = lhs[i] * rhs[i];
+  }
+}
+
+#ifdef SVC_BATCH_X86
+/* Points are stored interleaved: {x0, y0, x1, y1, ...}, so one register
+ * contains several points. Every point is transformed as
+ * `diag * {x, y} + cross * {y, x} + trans`, where diag is {a00, a11}, cross is
+ * {a01, a10} and trans is {a02, a12}. Boxes are transformed by same way:
+ * center of a box is transformed as point, and extents (halfs of sizes) are
+ * transformed by absolute values of diag and cross
+ */
+
+SVC_TARGET_SSE2 static void transformPointsSse2(const Affine &aff,
+                                                const Point * points,
+                                                Point *       out,
+                                                size_t        count) noexcept {
+  const __m128 diag =
+      _mm_setr_ps(aff.a[0][0], aff.a[1][1], aff.a[0][0], aff.a[1][1]);
+  const __m128 cross =
+      _mm_setr_ps(aff.a[0][1], aff.a[1][0], aff.a[0][1], aff.a[1][0]);
+  const __m128 trans =
+      _mm_setr_ps(aff.a[0][2], aff.a[1][2], aff.a[0][2], aff.a[1][2]);
+
+  size_t i = 0;
+  for (; i + 2 <= count; i += 2) {
+    __m128 xy = _mm_loadu_ps(points[i].a);
+    __m128 yx = _mm_shuffle_ps(xy, xy, _MM_SHUFFLE(2, 3, 0, 1));
+
+    __m128 result = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(diag, xy), _mm_mul_ps(cross, yx)),
+        trans);
+    _mm_storeu_ps(out[i].a, result);
+  }
+  for (; i < count; ++i) {
+    out[i] = transformPoint(aff, points[i]);
+  }
+}
+
+SVC_TARGET_SSE2 static void transformBoxesSse2(const Affine *transforms,
+                                               const Box *   boxes,
+                                               Box *         out,
+                                               size_t count) noexcept {
+  const __m128 half    = _mm_set1_ps(0.5f);
+  const __m128 signBit = _mm_set1_ps(-0.f);
+
+  size_t i = 0;
+  for (; i + 2 <= count; i += 2) {
+    const Affine &first  = transforms[i];
+    const Affine &second = transforms[i + 1];
+
+    __m128 diag  = _mm_setr_ps(first.a[0][0],
+                              first.a[1][1],
+                              second.a[0][0],
+                              second.a[1][1]);
+    __m128 cross = _mm_setr_ps(first.a[0][1],
+                               first.a[1][0],
+                               second.a[0][1],
+                               second.a[1][0]);
+    __m128 trans = _mm_setr_ps(first.a[0][2],
+                               first.a[1][2],
+                               second.a[0][2],
+                               second.a[1][2]);
+
+    // box is stored as {minX, minY, maxX, maxY}
+    __m128 firstBox  = _mm_loadu_ps(boxes[i].min_corner().a);
+    __m128 secondBox = _mm_loadu_ps(boxes[i + 1].min_corner().a);
+    __m128 mins      = _mm_movelh_ps(firstBox, secondBox);
+    __m128 maxs      = _mm_movehl_ps(secondBox, firstBox);
+
+    __m128 extent   = _mm_mul_ps(_mm_sub_ps(maxs, mins), half);
+    __m128 center   = _mm_add_ps(mins, extent);
+    __m128 extentYX = _mm_shuffle_ps(extent, extent, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 centerYX = _mm_shuffle_ps(center, center, _MM_SHUFFLE(2, 3, 0, 1));
+
+    center = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(diag, center), _mm_mul_ps(cross, centerYX)),
+        trans);
+    extent = _mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signBit, diag), extent),
+                        _mm_mul_ps(_mm_andnot_ps(signBit, cross), extentYX));
+
+    mins = _mm_sub_ps(center, extent);
+    maxs = _mm_add_ps(center, extent);
+    _mm_storeu_ps(out[i].min_corner().a, _mm_movelh_ps(mins, maxs));
+    _mm_storeu_ps(out[i + 1].min_corner().a, _mm_movehl_ps(maxs, mins));
+  }
+  for (; i < count; ++i) {
+    out[i] = transformBox(transforms[i], boxes[i]);
+  }
+}
+
+SVC_TARGET_SSE2 static void composeTransformsSse2(const Affine *lhs,
+                                                  const Affine *rhs,
+                                                  Affine *      out,
+                                                  size_t count) noexcept {
+  // XXX every row of result is `l0 * rhsRow0 + l1 * rhsRow1 + {0, 0, l2}`.
+  // Rows are loaded by 4 floats, so loading of second row of last pair reads
+  // after end of the array, and the last pair is composed by scalar code
+  size_t i = 0;
+  for (; i + 1 < count; ++i) {
+    const Affine &left = lhs[i];
+
+    __m128 rhsRow0 = _mm_loadu_ps(rhs[i].a[0]);
+    __m128 rhsRow1 = _mm_loadu_ps(rhs[i].a[1]);
+
+    __m128 row0 =
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(left.a[0][0]), rhsRow0),
+                              _mm_mul_ps(_mm_set1_ps(left.a[0][1]), rhsRow1)),
+                   _mm_setr_ps(0, 0, left.a[0][2], 0));
+    __m128 row1 =
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(left.a[1][0]), rhsRow0),
+                              _mm_mul_ps(_mm_set1_ps(left.a[1][1]), rhsRow1)),
+                   _mm_setr_ps(0, 0, left.a[1][2], 0));
+
+    // first row is written by 4 floats, last of them is rewritten by second
+    // row, which is written exactly by 3 floats
+    _mm_storeu_ps(out[i].a[0], row0);
+    _mm_storel_pi(reinterpret_cast<__m64 *>(out[i].a[1]), row1);
+    _mm_store_ss(&out[i].a[1][2], _mm_movehl_ps(row1, row1));
+  }
+  for (; i < count; ++i) {
+    out[i] = lhs[i] * rhs[i];
+  }
+}
+
+SVC_TARGET_AVX2 static void transformPointsAvx2(const Affine &aff,
+                                                const Point * points,
+                                                Point *       out,
+                                                size_t        count) noexcept {
+  const __m256 diag  = _mm256_setr_ps(aff.a[0][0],
+                                     aff.a[1][1],
+                                     aff.a[0][0],
+                                     aff.a[1][1],
+                                     aff.a[0][0],
+                                     aff.a[1][1],
+                                     aff.a[0][0],
+                                     aff.a[1][1]);
+  const __m256 cross = _mm256_setr_ps(aff.a[0][1],
+                                      aff.a[1][0],
+                                      aff.a[0][1],
+                                      aff.a[1][0],
+                                      aff.a[0][1],
+                                      aff.a[1][0],
+                                      aff.a[0][1],
+                                      aff.a[1][0]);
+  const __m256 trans = _mm256_setr_ps(aff.a[0][2],
+                                      aff.a[1][2],
+                                      aff.a[0][2],
+                                      aff.a[1][2],
+                                      aff.a[0][2],
+                                      aff.a[1][2],
+                                      aff.a[0][2],
+                                      aff.a[1][2]);
+
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m256 xy = _mm256_loadu_ps(points[i].a);
+    __m256 yx = _mm256_permute_ps(xy, _MM_SHUFFLE(2, 3, 0, 1));
+
+    __m256 result = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(diag, xy), _mm256_mul_ps(cross, yx)),
+        trans);
+    _mm256_storeu_ps(out[i].a, result);
+  }
+  for (; i < count; ++i) {
+    out[i] = transformPoint(aff, points[i]);
+  }
+}
+
+SVC_TARGET_AVX2 static void transformBoxesAvx2(const Affine *transforms,
+                                               const Box *   boxes,
+                                               Box *         out,
+                                               size_t count) noexcept {
+  const __m256 half    = _mm256_set1_ps(0.5f);
+  const __m256 signBit = _mm256_set1_ps(-0.f);
+
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    // XXX unpacking works inside 128 bit lanes, so after unpacking order of
+    // boxes in registers is {0, 2, 1, 3}
+    const Affine &t0 = transforms[i];
+    const Affine &t1 = transforms[i + 1];
+    const Affine &t2 = transforms[i + 2];
+    const Affine &t3 = transforms[i + 3];
+
+    __m256 diag  = _mm256_setr_ps(t0.a[0][0],
+                                 t0.a[1][1],
+                                 t2.a[0][0],
+                                 t2.a[1][1],
+                                 t1.a[0][0],
+                                 t1.a[1][1],
+                                 t3.a[0][0],
+                                 t3.a[1][1]);
+    __m256 cross = _mm256_setr_ps(t0.a[0][1],
+                                  t0.a[1][0],
+                                  t2.a[0][1],
+                                  t2.a[1][0],
+                                  t1.a[0][1],
+                                  t1.a[1][0],
+                                  t3.a[0][1],
+                                  t3.a[1][0]);
+    __m256 trans = _mm256_setr_ps(t0.a[0][2],
+                                  t0.a[1][2],
+                                  t2.a[0][2],
+                                  t2.a[1][2],
+                                  t1.a[0][2],
+                                  t1.a[1][2],
+                                  t3.a[0][2],
+                                  t3.a[1][2]);
+
+    __m256d firstBoxes  = _mm256_castps_pd(
+        _mm256_loadu_ps(boxes[i].min_corner().a));
+    __m256d secondBoxes = _mm256_castps_pd(
+        _mm256_loadu_ps(boxes[i + 2].min_corner().a));
+    __m256 mins =
+        _mm256_castpd_ps(_mm256_unpacklo_pd(firstBoxes, secondBoxes));
+    __m256 maxs =
+        _mm256_castpd_ps(_mm256_unpackhi_pd(firstBoxes, secondBoxes));
+
+    __m256 extent   = _mm256_mul_ps(_mm256_sub_ps(maxs, mins), half);
+    __m256 center   = _mm256_add_ps(mins, extent);
+    __m256 extentYX = _mm256_permute_ps(extent, _MM_SHUFFLE(2, 3, 0, 1));
+    __m256 centerYX = _mm256_permute_ps(center, _MM_SHUFFLE(2, 3, 0, 1));
+
+    center = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(diag, center),
+                                         _mm256_mul_ps(cross, centerYX)),
+                           trans);
+    extent = _mm256_add_ps(
+        _mm256_mul_ps(_mm256_andnot_ps(signBit, diag), extent),
+        _mm256_mul_ps(_mm256_andnot_ps(signBit, cross), extentYX));
+
+    __m256d newMins = _mm256_castps_pd(_mm256_sub_ps(center, extent));
+    __m256d newMaxs = _mm256_castps_pd(_mm256_add_ps(center, extent));
+    _mm256_storeu_ps(out[i].min_corner().a,
+                     _mm256_castpd_ps(_mm256_unpacklo_pd(newMins, newMaxs)));
+    _mm256_storeu_ps(out[i + 2].min_corner().a,
+                     _mm256_castpd_ps(_mm256_unpackhi_pd(newMins, newMaxs)));
+  }
+  for (; i < count; ++i) {
+    out[i] = transformBox(transforms[i], boxes[i]);
+  }
+}
+
+static const BatchKernels sse2Kernels{BatchKernel::Sse2,
+                                      transformPointsSse2,
+                                      transformBoxesSse2,
+                                      composeTransformsSse2};
+
+// XXX one transformation is too small for 256 bit registers, so composing
+// uses SSE2 implementation
+static const BatchKernels avx2Kernels{BatchKernel::Avx2,
+                                      transformPointsAvx2,
+                                      transformBoxesAvx2,
+                                      composeTransformsSse2};
+#endif
+
+static const BatchKernels scalarKernels{BatchKernel::Scalar,
+                                        transformPointsScalar,
+                                        transformBoxesScalar,
+                                        composeTransformsScalar};
+
+/**\return nullptr if the kernel is not supported by the processor
+ */
+static const BatchKernels *findKernels(BatchKernel kernel) noexcept {
+  switch (kernel) {
+#ifdef SVC_BATCH_X86
+  case BatchKernel::Avx2:
+    return __builtin_cpu_supports("avx2") ? &avx2Kernels : nullptr;
+  case BatchKernel::Sse2:
+    return __builtin_cpu_supports("sse2") ? &sse2Kernels : nullptr;
+#endif
+  case BatchKernel::Scalar:
+    return &scalarKernels;
+  default:
+    return nullptr;
+  }
+}
+
+static const BatchKernels *selectKernels() noexcept {
+#ifdef SVC_BATCH_X86
+  // XXX needed if kernels are selected before constructors of libgcc
+  __builtin_cpu_init();
+#endif
+
+  for (BatchKernel kernel : {BatchKernel::Avx2, BatchKernel::Sse2}) {
+    if (const BatchKernels *kernels = findKernels(kernel)) {
+      return kernels;
+    }
+  }
+  return &scalarKernels;
+}
+
+static std::atomic<const BatchKernels *> &currentKernels() noexcept {
+  static std::atomic<const BatchKernels *> kernels{selectKernels()};
+  return kernels;
+}
+
+const char *toString(BatchKernel kernel) noexcept {
+  switch (kernel) {
+  case BatchKernel::Scalar:
+    return "Scalar";
+  case BatchKernel::Sse2:
+    return "Sse2";
+  case BatchKernel::Avx2:
+    return "Avx2";
+  }
+  return "Unknown";
+}
+
+BatchKernel getBatchKernel() noexcept {
+  return currentKernels().load(std::memory_order_relaxed)->kernel;
+}
+
+bool setBatchKernel(BatchKernel kernel) noexcept {
+  const BatchKernels *kernels = findKernels(kernel);
+  if (kernels == nullptr) {
+    return false;
+  }
+
+  currentKernels().store(kernels, std::memory_order_relaxed);
+  return true;
+}
+
+void transformPoints(const Affine &aff,
+                     const Point * points,
+                     Point *       out,
+                     size_t        count) noexcept {
+  currentKernels().load(std::memory_order_relaxed)->transformPoints(aff,
+                                                                    points,
+                                                                    out,
+                                                                    count);
+}
+
+void transformBoxes(const Affine *transforms,
+                    const Box *   boxes,
+                    Box *         out,
+                    size_t        count) noexcept {
+  currentKernels().load(std::memory_order_relaxed)->transformBoxes(transforms,
+                                                                   boxes,
+                                                                   out,
+                                                                   count);
+}
+
+void composeTransforms(const Affine *lhs,
+                       const Affine *rhs,
+                       Affine *      out,
+                       size_t        count) noexcept {
+  currentKernels().load(std::memory_order_relaxed)->composeTransforms(lhs,
+                                                                      rhs,
+                                                                      out,
+                                                                      count);
+}
+} // namespace svc
@@ -1,41 +1,42 @@
 // Rect.cpp
 
+#include "svc/BatchTransform.hpp"
 #include "svc/base_geometry_types.hpp"
-#include <boost/geometry/algorithms/transform.hpp>
-#include <boost/geometry/strategies/transform/matrix_transformers.hpp>
-#include <boost/qvm/map_mat_vec.hpp>
-#include <boost/qvm/map_vec_mat.hpp>
+#include <boost/geometry/algorithms/convert.hpp>
 
 namespace svc {
 Rect::Rect(Point minCorner, Size size, float angle, Point anchor)
-    : matrix_{}
+    : transform_{Affine::translation(minCorner)}
+    , decomposition_{Decomposition::rotation(angle)}
     , size_{size} {
-  matrix_ = bq::translation_mat(minCorner);
-
   // and rotate
-  Matrix translationMat = bq::translation_mat(anchor);
-
-  Matrix rotationMat = translationMat;
-  rotationMat *= bq::rotz_mat<3>(angle);
-  rotationMat *= bq::inverse(translationMat);
+  transform_ *= Affine::rotation(decomposition_, anchor);
+}
 
-  matrix_ *= rotationMat;
+Rect::Rect(Point minCorner, Size size, const Decomposition &rotation)
+    : transform_{Affine::translation(minCorner)}
+    , decomposition_{rotation.angle,
+                     rotation.sinAngle,
+                     rotation.cosAngle,
+                     {1, 1}}
+    , size_{size} {
+  transform_ *= Affine::rotation(decomposition_, Point{0, 0});
 }
 
-Rect::Rect(Box box) {
+Rect::Rect(Box box)
+    : decomposition_{Decomposition::identity()} {
   svc::Point diag = box.max_corner() - box.min_corner();
   size_           = svc::Size{diag.x(), diag.y()};
 
-  matrix_ = bq::translation_mat(box.min_corner());
+  transform_ = Affine::translation(box.min_corner());
 }
 
 void Rect::setMinCorner(Point minCorner) noexcept {
-  bq::translation(matrix_) = minCorner;
+  transform_.setTranslation(minCorner);
 }
 
 Point Rect::getMinCorner() const noexcept {
-  Point minCorner = bq::translation(matrix_);
-  return minCorner;
+  return transform_.getTranslation();
 }
 
 void Rect::setSize(Size size) noexcept {
@@ -47,55 +48,64 @@ Size Rect::size() const noexcept {
 }
 
 void Rect::rotate(float angle, Point anchor) noexcept {
-  Matrix translationMat = bq::translation_mat(anchor);
-
-  Matrix rotationMat = translationMat;
-  rotationMat *= bq::rotz_mat<3>(angle);
-  rotationMat *= bq::inverse(translationMat);
-
-  matrix_ *= rotationMat;
+  transform_ *= Affine::rotation(angle, anchor);
+
+  // XXX if the transformation was scaled, then its rotation can not be just
+  // summed
+  if (decomposition_.scaleFactors == ScaleFactors{1, 1}) {
+    decomposition_ = Decomposition::rotation(decomposition_.angle + angle);
+  } else {
+    decomposition_ = decompose(transform_);
+  }
 }
 
 void Rect::setRotation(float angle, Point anchor) noexcept {
-  Matrix translationMat = bq::translation_mat(anchor);
+  decomposition_ = Decomposition::rotation(angle);
 
-  Matrix resultMat = bq::translation_mat(bq::translation(matrix_));
-  resultMat *= translationMat;
-  resultMat *= bq::rotz_mat<3>(angle);
-  resultMat *= bq::inverse(translationMat);
-
-  matrix_ = std::move(resultMat);
+  transform_ = Affine::translation(transform_.getTranslation()) *
+               Affine::rotation(decomposition_, anchor);
 }
 
 float Rect::getRotation() const noexcept {
-  float angle = svc::getRotation(matrix_);
-  return NORM_RADIANS(angle);
+  return NORM_RADIANS(decomposition_.angle);
+}
+
+const Decomposition &Rect::getDecomposition() const noexcept {
+  return decomposition_;
 }
 
 void Rect::setMatrix(Matrix mat) noexcept {
-  matrix_ = std::move(mat);
+  this->setTransform(toAffine(mat));
 }
 
 Matrix Rect::getMatrix() const noexcept {
-  return matrix_;
+  return toMatrix(transform_);
 }
 
-void Rect::moveOn(Point diff) noexcept {
-  matrix_ *= bq::translation_mat(diff);
+void Rect::setTransform(const Affine &transform) noexcept {
+  transform_     = transform;
+  decomposition_ = decompose(transform_);
 }
 
-Rect::operator Ring() const noexcept {
-  Box box{{0, 0}, Point(this->size())};
+Affine Rect::getTransform() const noexcept {
+  return transform_;
+}
 
-  Ring baseRing;
-  bg::convert(box, baseRing);
+void Rect::moveOn(Point diff) noexcept {
+  transform_ *= Affine::translation(diff);
+}
 
+Rect::operator Ring() const noexcept {
   Ring retval;
-  bg::transform(
-      baseRing,
-      retval,
-      bg::strategy::transform::matrix_transformer<float, 2, 2>{matrix_});
-
+  this->toRing(retval);
   return retval;
 }
+
+void Rect::toRing(Ring &ring) const noexcept {
+  Box box{{0, 0}, Point(this->size())};
+
+  // XXX convert clears the ring, so its capacity is kept
+  bg::convert(box, ring);
+  transformPoints(transform_, ring.data(), ring.data(), ring.size());
+}
 } // namespace svc
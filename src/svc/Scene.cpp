@@ -3,22 +3,57 @@
 #include "svc/Scene.hpp"
 #include "asserts.hpp"
 #include "logs.hpp"
+#include "trace.hpp"
 #include "svc/AbstractItem.hpp"
+#include "svc/BatchTransform.hpp"
 #include "svc/base_geometry_types.hpp"
 #include <boost/function_output_iterator.hpp>
+// XXX without exceptions gcc can not prove that rescale policy of boost
+// geometry always initializes its factor, so the false warning is suppressed
+// only for boost headers
+#if defined(__GNUC__) && !defined(__clang__)
+#  pragma GCC diagnostic push
+#  pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#include <boost/geometry/algorithms/convert.hpp>
+#include <boost/geometry/algorithms/covered_by.hpp>
+#include <boost/geometry/algorithms/envelope.hpp>
+#include <boost/geometry/algorithms/expand.hpp>
+#include <boost/geometry/algorithms/intersects.hpp>
+#include <boost/geometry/algorithms/within.hpp>
+#include <boost/geometry/core/is_areal.hpp>
 #include <boost/geometry/index/rtree.hpp>
 #include <boost/geometry/strategies/strategies.hpp>
-#include <boost/qvm/map_vec_mat.hpp>
+#if defined(__GNUC__) && !defined(__clang__)
+#  pragma GCC diagnostic pop
+#endif
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <iterator>
 #include <list>
+#include <memory_resource>
+#include <unordered_map>
+#include <vector>
 
 #ifndef NDEBUG
-#  include <boost/geometry/algorithms/is_convex.hpp>
 #  include <boost/geometry/algorithms/is_valid.hpp>
 #endif
 
+#ifdef SVC_SCENE_STATS
+#  include <array>
+#  include <chrono>
+#  include <limits>
+#endif
+
 #define MAX_NUMBER_VALUES_IN_NODE 16
 
+/**\brief if count of values for bulk inserting or removing is more then
+ * `size of tree / BULK_REPACK_DIVISOR`, then the tree will be repacked instead
+ * of inserting or removing values one by one
+ */
+#define BULK_REPACK_DIVISOR 4
+
 namespace bg = boost::geometry;
 
 using TranslateStrategy = bg::strategy::transform::translate_transformer<
@@ -27,9 +62,366 @@ using TranslateStrategy = bg::strategy::transform::translate_transformer<
     bg::traits::dimension<svc::Point>::value>;
 
 namespace svc {
+/**\brief intersect ray `origin + t * direction` with the box by slab method
+ *
+ * \return minimal t in [0, tMax] for which the ray is inside the box, or
+ * nothing if the ray misses the box
+ */
+static std::optional<float> rayBoxEntry(Point      origin,
+                                        Point      direction,
+                                        float      tMax,
+                                        const Box &box) noexcept {
+  float tMin = 0;
+  for (int i = 0; i < 2; ++i) {
+    float minCorner = box.min_corner().a[i];
+    float maxCorner = box.max_corner().a[i];
+
+    if (direction.a[i] == 0) {
+      if (origin.a[i] < minCorner || origin.a[i] > maxCorner) {
+        return std::nullopt;
+      }
+      continue;
+    }
+
+    float t1 = (minCorner - origin.a[i]) / direction.a[i];
+    float t2 = (maxCorner - origin.a[i]) / direction.a[i];
+    if (t1 > t2) {
+      std::swap(t1, t2);
+    }
+
+    tMin = std::max(tMin, t1);
+    tMax = std::min(tMax, t2);
+    if (tMin > tMax) {
+      return std::nullopt;
+    }
+  }
+
+  return tMin;
+}
+
+/**\return distance from the point to nearest point of the box
+ */
+static float pointBoxDistance(Point point, const Box &box) noexcept {
+  float dx = std::max({box.min_corner().x() - point.x(),
+                       0.f,
+                       point.x() - box.max_corner().x()});
+  float dy = std::max({box.min_corner().y() - point.y(),
+                       0.f,
+                       point.y() - box.max_corner().y()});
+  return std::sqrt(dx * dx + dy * dy);
+}
+
+/**\brief call the function for every descendant of the Item (without the
+ * Item) in pre-order
+ *
+ * \warning the function must not change hierarchy of the subtree
+ */
+template <typename Function>
+static void forEachDescendant(const AbstractItem *item, Function &&function) {
+  for (const ItemPtr &child : item->getSubtree()) {
+    function(child);
+  }
+}
+
+/**\return first status, if it is not Ok, otherwise the second one. Used for
+ * combining of results of operations with several Items
+ */
+static Status firstFailure(Status first, Status second) noexcept {
+  return first != Status::Ok ? first : second;
+}
+
+/**\return bounding box of the circle
+ */
+static Box circleBox(Point center, float radius) noexcept {
+  return Box{{center.x() - radius, center.y() - radius},
+             {center.x() + radius, center.y() + radius}};
+}
+
+/**\return envelope of the geometry
+ */
+template <typename GeometryType>
+static Box envelopeOf(const GeometryType &geometry) {
+  return bg::return_envelope<Box>(geometry);
+}
+
+/**\brief envelope of multi polygon is built from outer rings of its polygons
+ *
+ * \note boost envelope of multi geometries produces maybe-uninitialized
+ * warnings in release builds, so it is not used
+ *
+ * \warning the multi polygon must not be empty
+ */
+static Box envelopeOf(const MultiPolygon &multiPolygon) {
+  Box retval;
+  bg::assign_inverse(retval);
+  for (const Polygon &polygon : multiPolygon) {
+    for (const Point &point : polygon.outer()) {
+      bg::expand(retval, point);
+    }
+  }
+  return retval;
+}
+
+/**\brief snapshot owned by the Scene. Readers get the snapshot by
+ * shared_ptr, which doesn't destroy it, but only marks it as free, so Items of
+ * the snapshot are never released by reader threads. The snapshot is destroyed
+ * by reader only if the Scene was destroyed before
+ */
+struct SnapshotHolder {
+  enum State : int {
+    Free,
+    InUse,
+    /// the Scene was destroyed while the snapshot was in use
+    Orphaned,
+  };
+
+  std::unique_ptr<SceneSnapshot> snapshot;
+  std::atomic<int>               state{Free};
+
+  /**\brief deleter of snapshots given to readers
+   */
+  struct Releaser {
+    SnapshotHolder *holder;
+
+    void operator()(const SceneSnapshot *) const noexcept {
+      if (holder->state.exchange(Free, std::memory_order_acq_rel) ==
+          Orphaned) {
+        delete holder;
+      }
+    }
+  };
+};
+
+/**\brief two snapshots, which are updated in turn. While one of them is used
+ * by readers the other one can be updated. Changed Items are remembered with
+ * bit of every slot, which was not updated yet, so update costs O(changed
+ * Items)
+ */
+struct SnapshotBuffers {
+  struct Slot {
+    SnapshotHolder *holder = nullptr;
+
+    /// set if the snapshot can not be updated by changed Items
+    bool needRebuild = true;
+  };
+
+  /**\param resource must outlive the buffers
+   */
+  explicit SnapshotBuffers(std::pmr::memory_resource *resource) noexcept
+      : changed{resource} {
+  }
+
+  /**\brief snapshots, which are still used by readers, are passed to them
+   */
+  ~SnapshotBuffers() noexcept {
+    for (Slot &slot : slots) {
+      release(slot.holder);
+    }
+    for (SnapshotHolder *holder : retired) {
+      release(holder);
+    }
+  }
+
+  static void release(SnapshotHolder *holder) noexcept {
+    if (holder != nullptr &&
+        holder->state.exchange(SnapshotHolder::Orphaned,
+                               std::memory_order_acq_rel) ==
+            SnapshotHolder::Free) {
+      delete holder;
+    }
+  }
+
+  /**\return holder from retired ones, which is not used anymore, or nullptr
+   */
+  SnapshotHolder *takeFree() noexcept {
+    for (auto iter = retired.begin(); iter != retired.end(); ++iter) {
+      SnapshotHolder *holder = *iter;
+      if (holder->state.load(std::memory_order_acquire) ==
+          SnapshotHolder::Free) {
+        retired.erase(iter);
+        return holder;
+      }
+    }
+    return nullptr;
+  }
+
+  Slot slots[2];
+
+  /// index of slot, which will be updated by next snapshot
+  int back = 0;
+
+  /// changed Items with bits of slots, which must be updated
+  std::pmr::unordered_map<const AbstractItem *, uint8_t> changed;
+
+  /// snapshots replaced in slots while they were used by readers
+  std::vector<SnapshotHolder *> retired;
+};
+
+/**\brief remembers size and alignment of first allocation after reset. Used
+ * for getting size of nodes of containers, which don't provide it. Memory is
+ * taken from global heap
+ */
+class NodeSizeProbe final : public std::pmr::memory_resource {
+public:
+  size_t size      = 0;
+  size_t alignment = 0;
+
+  void reset() noexcept {
+    size      = 0;
+    alignment = 0;
+  }
+
+private:
+  void *do_allocate(size_t bytes, size_t align) override {
+    if (size == 0) {
+      size      = bytes;
+      alignment = align;
+    }
+    return std::pmr::new_delete_resource()->allocate(bytes, align);
+  }
+
+  void do_deallocate(void *p, size_t bytes, size_t align) override {
+    std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+  }
+
+  bool do_is_equal(
+      const std::pmr::memory_resource &other) const noexcept override {
+    return this == &other;
+  }
+};
+
+#ifdef SVC_SCENE_STATS
+/**\brief collects statistic of Scene operations. All counters are atomic, so
+ * const queries can be called concurrently
+ *
+ * \note statistic is not taken atomically as whole, so counters of operations
+ * called concurrently with taking can be a bit inconsistent
+ */
+class SceneStatsRecorder {
+public:
+  void record(SceneOperation operation,
+              uint64_t       latency,
+              uint64_t       hits) noexcept {
+    Operation &op = operations_[size_t(operation)];
+
+    op.count.fetch_add(1, std::memory_order_relaxed);
+    op.hits.fetch_add(hits, std::memory_order_relaxed);
+    op.buckets[LatencyHistogram::bucketIndex(latency)].fetch_add(
+        1,
+        std::memory_order_relaxed);
+    op.sum.fetch_add(latency, std::memory_order_relaxed);
+
+    uint64_t min = op.min.load(std::memory_order_relaxed);
+    while (latency < min && !op.min.compare_exchange_weak(
+                                min, latency, std::memory_order_relaxed)) {
+    }
+    uint64_t max = op.max.load(std::memory_order_relaxed);
+    while (latency > max && !op.max.compare_exchange_weak(
+                                max, latency, std::memory_order_relaxed)) {
+    }
+  }
+
+  void countCandidates(SceneOperation operation, uint64_t candidates) noexcept {
+    operations_[size_t(operation)].candidates.fetch_add(
+        candidates,
+        std::memory_order_relaxed);
+  }
+
+  SceneStats get(bool reset) noexcept {
+    SceneStats stats;
+    stats.enabled = true;
+
+    for (size_t i = 0; i < operations_.size(); ++i) {
+      Operation &     op     = operations_[i];
+      OperationStats &opStat = stats.operations[i];
+
+      opStat.count      = take(op.count, reset, 0);
+      opStat.candidates = take(op.candidates, reset, 0);
+      opStat.hits       = take(op.hits, reset, 0);
+
+      LatencyHistogram &latency = opStat.latency;
+      for (size_t j = 0; j < LatencyHistogram::BucketsCount; ++j) {
+        latency.buckets_[j] = take(op.buckets[j], reset, 0);
+        latency.count_ += latency.buckets_[j];
+      }
+      latency.sum_ = take(op.sum, reset, 0);
+      latency.min_ = take(op.min, reset, std::numeric_limits<uint64_t>::max());
+      latency.max_ = take(op.max, reset, 0);
+    }
+
+    return stats;
+  }
+
+private:
+  static uint64_t
+  take(std::atomic<uint64_t> &val, bool reset, uint64_t initial) noexcept {
+    if (reset) {
+      return val.exchange(initial, std::memory_order_relaxed);
+    }
+    return val.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct Operation {
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> candidates{0};
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> min{std::numeric_limits<uint64_t>::max()};
+    std::atomic<uint64_t> max{0};
+
+    std::array<std::atomic<uint64_t>, LatencyHistogram::BucketsCount> buckets{};
+  };
+
+  std::array<Operation, size_t(SceneOperation::Count_)> operations_;
+};
+
+/**\brief measure latency of Scene operation from construction to destruction
+ */
+class StatsScope {
+  using Clock = std::chrono::steady_clock;
+
+public:
+  StatsScope(SceneStatsRecorder *recorder, SceneOperation operation) noexcept
+      : recorder_{recorder}
+      , operation_{operation}
+      , hits_{0}
+      , start_{Clock::now()} {
+  }
+
+  ~StatsScope() noexcept {
+    uint64_t latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           Clock::now() - start_)
+                           .count();
+    recorder_->record(operation_, latency, hits_);
+  }
+
+  void setHits(size_t hits) noexcept {
+    hits_ = hits;
+  }
+
+private:
+  SceneStatsRecorder *recorder_;
+  SceneOperation      operation_;
+  size_t              hits_;
+  Clock::time_point   start_;
+};
+
+#  define SCENE_STATS_SCOPE(operation)                                         \
+    StatsScope statsScope {                                                    \
+      imp_->getStatsRecorder(), operation                                      \
+    }
+#  define SCENE_STATS_HITS(hits) statsScope.setHits(hits)
+#else
+#  define SCENE_STATS_SCOPE(operation)
+#  define SCENE_STATS_HITS(hits)
+#endif
+
+class SceneSnapshotImp;
+
 class SceneImp {
-  enum ValueTypes { BoxType, ItemType };
-  using Value = std::tuple<Box, ItemPtr>;
+  enum ValueTypes { BoxType, ItemType, FlagsType };
+  using Value = std::tuple<Box, ItemPtr, ItemFlags>;
   struct ValueComparator {
     bool operator()(const Value &first, const Value &second) const {
       if (std::get<ItemType>(first) == std::get<ItemType>(second)) {
@@ -39,69 +431,211 @@ class SceneImp {
     }
   };
 
-  using Index = bg::index::quadratic<MAX_NUMBER_VALUES_IN_NODE>;
-  using RTree = bg::index::
-      rtree<Value, Index, bg::index::indexable<Value>, ValueComparator>;
+  using Index     = bg::index::quadratic<MAX_NUMBER_VALUES_IN_NODE>;
+  using Allocator = std::pmr::polymorphic_allocator<Value>;
+  using RTree     = bg::index::rtree<Value,
+                                 Index,
+                                 bg::index::indexable<Value>,
+                                 ValueComparator,
+                                 Allocator>;
+
+  /**\brief copies of all values from the tree, needed for finding values of
+   * Items without linear search
+   */
+  using ValueMap = std::pmr::unordered_map<const AbstractItem *, Value>;
 
 public:
+  /**\brief uses own pool resource for all allocations
+   */
   SceneImp() noexcept
-      : tree_{} {
+      : ownResource_{std::make_unique<std::pmr::unsynchronized_pool_resource>()}
+      , tree_{Index{}, {}, {}, Allocator{ownResource_.get()}}
+      , values_{ownResource_.get()}
+      , oldValues_{ownResource_.get()}
+      , newValues_{ownResource_.get()} {
   }
 
-  void appendItem(ItemPtr item) {
-    // all Items we store by its bounding boxes, BUT! bounding boxes defined in
-    // Items koordinates (without rotating), so we need translate it to Scene
-    // koordinates
-    Box   itemBoundingBox = item->getBoundingBox();
-    Point itemScenePos    = item->getScenePos();
+  /**\param resource must outlive the SceneImp
+   */
+  explicit SceneImp(std::pmr::memory_resource *resource) noexcept
+      : ownResource_{}
+      , tree_{Index{}, {}, {}, Allocator{resource}}
+      , values_{resource}
+      , oldValues_{resource}
+      , newValues_{resource} {
+  }
 
-    Box sceneBoundingBox;
-    bg::transform(itemBoundingBox,
-                  sceneBoundingBox,
-                  TranslateStrategy{itemScenePos.x(), itemScenePos.y()});
+  /**\brief preallocate memory for n values
+   */
+  void reserve(size_t n) {
+    values_.reserve(n);
+    oldValues_.reserve(n);
+    newValues_.reserve(n);
+
+    // XXX neither rtree nor map provide reserve method for their nodes, so
+    // blocks of node size are allocated directly from the resource and
+    // returned back. Pool resource keeps freed blocks for later nodes. Other
+    // resources (for example monotonic arena) can not reuse freed memory, so
+    // for them only vectors are reserved
+    std::pmr::memory_resource *resource = values_.get_allocator().resource();
+    if (dynamic_cast<std::pmr::unsynchronized_pool_resource *>(resource) ==
+            nullptr &&
+        dynamic_cast<std::pmr::synchronized_pool_resource *>(resource) ==
+            nullptr) {
+      return;
+    }
+
+    static const std::pair<size_t, size_t> mapNode  = getMapNodeSize();
+    static const std::pair<size_t, size_t> treeNode = getTreeNodeSize();
+
+    // XXX every node of the tree contains at least min elements, so count of
+    // all nodes (leafs and internal) is not more then n / (min - 1)
+    size_t treeNodes = n / (Index::get_min_elements() - 1) + 1;
+
+    std::vector<void *> blocks;
+    blocks.reserve(n + treeNodes);
+    for (size_t i = 0; i < n; ++i) {
+      blocks.emplace_back(resource->allocate(mapNode.first, mapNode.second));
+    }
+    for (size_t i = 0; i < treeNodes; ++i) {
+      blocks.emplace_back(resource->allocate(treeNode.first, treeNode.second));
+    }
 
-    tree_.insert(Value{sceneBoundingBox, std::move(item)});
+    for (size_t i = 0; i < n; ++i) {
+      resource->deallocate(blocks[i], mapNode.first, mapNode.second);
+    }
+    for (size_t i = n; i < blocks.size(); ++i) {
+      resource->deallocate(blocks[i], treeNode.first, treeNode.second);
+    }
   }
 
-  void removeItem(AbstractItem *item) {
-    auto found =
-        std::find_if(tree_.begin(), tree_.end(), [item](const Value &value) {
-          if (std::get<ValueTypes::ItemType>(value).get() == item) {
-            return true;
-          }
-          return false;
-        });
+  void appendItem(ItemPtr item, ItemFlags flags = 0) {
+    const AbstractItem *key = item.get();
+    Value value{getSceneBoundingBox(*item), std::move(item), flags};
 
-    if (found == tree_.end()) {
-      LOG_THROW(std::runtime_error, "item not found");
+    tree_.insert(value);
+    values_[key] = std::move(value);
+
+    this->touch(key);
+  }
+
+  Status removeItem(AbstractItem *item) {
+    auto found = values_.find(item);
+    if (found == values_.end()) {
+      return Status::NotFound;
     }
 
-    size_t count = tree_.remove(*found);
-    if (count == 0) {
-      LOG_THROW(std::runtime_error, "item not removed");
+    // XXX the value is erased even if it is missed in the tree, otherwise the
+    // Item will be never released
+    size_t count = tree_.remove(found->second);
+    values_.erase(found);
+
+    this->touch(item);
+    return count == 0 ? Status::NotIndexed : Status::Ok;
+  }
+
+  /**\brief update boxes of the Item and all its descendants in the index.
+   * Boxes of the subtree are computed by one pre-order pass (so scene matrix of
+   * every Item is computed from already cached matrix of its parent), and
+   * after it old values are removed and new values are inserted by one batch.
+   * If the subtree is big, then the tree is repacked instead
+   *
+   * \note the Scene doesn't keep own copy of transformations of Items. Items
+   * own them, because they must work without a Scene, so the copy only
+   * increases memory for every Item, and must be synchronized on every change
+   * of transformation or hierarchy
+   *
+   * \return NotFound if the Item is not in the Scene, NotIndexed if some value
+   * of the subtree was not found in the tree (the value will be inserted
+   * anyway)
+   */
+  Status updateSubtreePosition(AbstractItem *item) {
+    auto found = values_.find(item);
+    if (found == values_.end()) {
+      return Status::NotFound;
     }
+
+    this->moveValue(found->second);
+    forEachDescendant(item, [this](const ItemPtr &child) {
+      auto childFound = values_.find(child.get());
+      DEBBUG_ASSERT(childFound != values_.end(), "item of subtree not found");
+      if (childFound != values_.end()) {
+        this->moveValue(childFound->second);
+      }
+    });
+
+    Status status = Status::Ok;
+    if (newValues_.size() * BULK_REPACK_DIVISOR >= tree_.size()) {
+      this->repack();
+    } else {
+      size_t count = tree_.remove(oldValues_.begin(), oldValues_.end());
+      if (count != oldValues_.size()) {
+        status = Status::NotIndexed;
+      }
+      tree_.insert(newValues_.begin(), newValues_.end());
+    }
+
+    // XXX buffers keep their memory for next moving, but must not hold Items
+    oldValues_.clear();
+    newValues_.clear();
+
+    return status;
   }
 
-  void updateItemPosition(AbstractItem *item) {
-    auto found =
-        std::find_if(tree_.begin(), tree_.end(), [item](const Value &val) {
-          if (std::get<ValueTypes::ItemType>(val).get() == item) {
-            return true;
-          }
-          return false;
-        });
+  void setItemFlags(AbstractItem *item, ItemFlags flags) {
+    auto found = values_.find(item);
+    if (found == values_.end()) {
+      LOG_THROW(std::runtime_error, "item not found");
+    }
+
+    // XXX values in the tree are accessible only as const, so the value is
+    // reinserted with new flags
+    Value &value = found->second;
+    if (tree_.remove(value) == 0) {
+      LOG_THROW(std::runtime_error, "item not found in index");
+    }
+
+    std::get<ValueTypes::FlagsType>(value) = flags;
+    tree_.insert(value);
 
-    if (found == tree_.end()) {
+    this->touch(item);
+  }
+
+  ItemFlags getItemFlags(AbstractItem *item) const {
+    auto found = values_.find(item);
+    if (found == values_.end()) {
       LOG_THROW(std::runtime_error, "item not found");
     }
 
-    ItemPtr movingItem = std::get<ValueTypes::ItemType>(*found);
-    size_t  count      = tree_.remove(*found);
-    if (count == 0) {
-      LOG_THROW(std::runtime_error, "item not removed");
+    return std::get<ValueTypes::FlagsType>(found->second);
+  }
+
+  /**\brief remove from the Scene all subtrees, which root Items intersect the
+   * region
+   *
+   * \return root Items of removed subtrees
+   */
+  ItemList extract(Box region) {
+    ItemList           roots;
+    std::vector<Value> values = this->takeSubtrees(region, roots);
+    for (Value &val : values) {
+      std::get<ValueTypes::ItemType>(val)->setScene(nullptr);
     }
 
-    this->appendItem(std::move(movingItem));
+    return roots;
+  }
+
+  /**\brief move subtrees, which root Items intersect the region, from source
+   * to the Scene. Flags of Items are saved
+   */
+  void transferFrom(SceneImp &source, Box region, Scene *scene) {
+    ItemList           roots;
+    std::vector<Value> values = source.takeSubtrees(region, roots);
+    for (Value &val : values) {
+      std::get<ValueTypes::ItemType>(val)->setScene(scene);
+    }
+
+    this->appendValues(std::move(values));
   }
 
   size_t count() const noexcept {
@@ -114,8 +648,42 @@ public:
 
   void clear() noexcept {
     tree_.clear();
+    values_.clear();
+
+    if (buffers_) {
+      buffers_->changed.clear();
+      for (SnapshotBuffers::Slot &slot : buffers_->slots) {
+        slot.needRebuild = true;
+      }
+    }
+  }
+
+  /**\brief remember that transformation of the Item and all its children was
+   * changed, so snapshots need to be updated
+   */
+  void touchSubtree(AbstractItem *item) {
+    if (buffers_ == nullptr) {
+      return;
+    }
+
+    this->touch(item);
+    forEachDescendant(item, [this](const ItemPtr &child) {
+      this->touch(child.get());
+    });
   }
 
+  SceneSnapshotPtr snapshot();
+
+#ifdef SVC_SCENE_STATS
+  void enableStats() {
+    stats_ = std::make_unique<SceneStatsRecorder>();
+  }
+
+  SceneStatsRecorder *getStatsRecorder() const noexcept {
+    return stats_.get();
+  }
+#endif
+
   Box bounds() const noexcept {
     auto box = tree_.bounds();
     return Box{{bg::get<0>(box.min_corner()), bg::get<1>(box.min_corner())},
@@ -162,70 +730,671 @@ public:
     return ConstIterator{tree_.end()};
   }
 
-  ItemList query(Point pos) const noexcept {
+  ItemList query(Point pos, ItemFilter filter) const noexcept {
     ItemList retval;
 
-    auto back_inserter =
-        boost::make_function_output_iterator([&retval](const Value &val) {
-          retval.emplace_back(std::get<ValueTypes::ItemType>(val));
-        });
+    this->visit(pos, filter, [&retval](const Value &val) {
+      retval.emplace_back(std::get<ValueTypes::ItemType>(val));
+    });
+
+    return retval;
+  }
+
+  void query(Point pos, ItemBuffer &out, ItemFilter filter) const noexcept {
+    out.clear();
+
+    this->visit(pos, filter, [&out](const Value &val) {
+      out.emplace_back(std::get<ValueTypes::ItemType>(val).get());
+    });
+  }
+
+  template <typename GeometryType,
+            typename = typename std::enable_if<
+                bg::is_areal<GeometryType>::value>::type>
+  ItemList query(const GeometryType &geometry,
+                 Scene::SpatialIndex index,
+                 ItemFilter          filter) const noexcept {
+    ItemList retval;
 
-    tree_.query(bg::index::covers(pos), back_inserter);
+    this->visit(geometry, index, filter, [&retval](const Value &val) {
+      retval.emplace_back(std::get<ValueTypes::ItemType>(val));
+    });
 
     return retval;
   }
 
+  /**\param out ItemBuffer or SharedItemBuffer
+   */
   template <typename GeometryType,
+            typename BufferType,
             typename = typename std::enable_if<
                 bg::is_areal<GeometryType>::value>::type>
-  ItemList query(GeometryType                         geometry,
-                 [[maybe_unused]] Scene::SpatialIndex index) const noexcept {
+  void query(const GeometryType &geometry,
+             BufferType &        out,
+             Scene::SpatialIndex index,
+             ItemFilter          filter) const noexcept {
+    out.clear();
+
+    this->visit(geometry, index, filter, [&out](const Value &val) {
+      if constexpr (std::is_same_v<BufferType, SharedItemBuffer>) {
+        out.emplace_back(std::get<ValueTypes::ItemType>(val));
+      } else {
+        out.emplace_back(std::get<ValueTypes::ItemType>(val).get());
+      }
+    });
+  }
+
+  ItemList queryRadius(Point center, float radius, ItemFilter filter) const
+      noexcept {
     ItemList retval;
 
-    auto back_inserter =
-        boost::make_function_output_iterator([&retval](const Value &val) {
-          retval.emplace_back(std::get<ValueTypes::ItemType>(val));
+    // XXX the tree is traversed by bounding box of the circle, so we need
+    // check real distance for found values
+    auto checked_inserter = boost::make_function_output_iterator(
+        [&retval, center, radius](const Value &val) {
+          if (pointBoxDistance(center, std::get<ValueTypes::BoxType>(val)) <=
+              radius) {
+            retval.emplace_back(std::get<ValueTypes::ItemType>(val));
+          }
         });
 
+    this->filteredQuery(bg::index::intersects(circleBox(center, radius)),
+                        filter,
+                        checked_inserter);
+
+    return retval;
+  }
+
+  ItemList queryRadiusSorted(Point center, float radius, ItemFilter filter) const
+      noexcept {
+    ItemList retval;
+    if (tree_.empty()) {
+      return retval;
+    }
+
+    // values are traversed in order of distance from center, so we can stop
+    // on first value outside the circle
+    size_t candidates = 0;
+    for (auto iter = this->filteredQueryBegin(
+             bg::index::nearest(center, tree_.size()) &&
+                 bg::index::intersects(circleBox(center, radius)),
+             filter);
+         iter != tree_.qend();
+         ++iter) {
+      const Value &val = *iter;
+      ++candidates;
+      if (pointBoxDistance(center, std::get<ValueTypes::BoxType>(val)) >
+          radius) {
+        break;
+      }
+
+      retval.emplace_back(std::get<ValueTypes::ItemType>(val));
+    }
+    this->countCandidates(candidates);
+
+    return retval;
+  }
+
+  ItemList query(Segment           segment,
+                 ItemFilter        filter,
+                 Scene::Refinement refinement) const noexcept {
+    Point origin    = segment.first;
+    Point direction = segment.second - segment.first;
+
+    // parameter of the ray is relative to length of the segment
+    std::pmr::vector<std::pair<float, ItemPtr>> hits{
+        values_.get_allocator().resource()};
+
+    auto back_inserter = boost::make_function_output_iterator(
+        [this, &hits, origin, direction, refinement](const Value &val) {
+          if (std::optional<float> t =
+                  this->castOnValue(val, origin, direction, 1, refinement)) {
+            hits.emplace_back(*t, std::get<ValueTypes::ItemType>(val));
+          }
+        });
+
+    this->filteredQuery(bg::index::intersects(segment), filter, back_inserter);
+
+    std::stable_sort(hits.begin(),
+                     hits.end(),
+                     [](const auto &first, const auto &second) {
+                       return first.first < second.first;
+                     });
+
+    ItemList retval;
+    for (auto &[t, item] : hits) {
+      retval.emplace_back(std::move(item));
+    }
+
+    return retval;
+  }
+
+  std::optional<RayHit> raycast(Point             origin,
+                                Point             direction,
+                                float             maxDist,
+                                ItemFilter        filter,
+                                Scene::Refinement refinement) const noexcept {
+    float length = bq::mag(direction);
+    if (length == 0 || maxDist <= 0 || tree_.empty()) {
+      return std::nullopt;
+    }
+
+    direction = Point{direction.x() / length, direction.y() / length};
+
+    Segment ray{origin,
+                Point{origin.x() + direction.x() * maxDist,
+                      origin.y() + direction.y() * maxDist}};
+
+    // XXX values are traversed in order of distance from origin to their
+    // boxes. Distance to a box is never greater then distance to the first
+    // intersection of the ray with the box, so when distance to next box is
+    // greater then the best hit we can stop
+    std::optional<RayHit> retval;
+    size_t                candidates = 0;
+    for (auto iter = this->filteredQueryBegin(
+             bg::index::nearest(origin, tree_.size()) &&
+                 bg::index::intersects(ray),
+             filter);
+         iter != tree_.qend();
+         ++iter) {
+      const Value &val = *iter;
+      ++candidates;
+
+      if (retval && pointBoxDistance(origin, std::get<ValueTypes::BoxType>(
+                                                 val)) > retval->distance) {
+        break;
+      }
+
+      std::optional<float> t =
+          this->castOnValue(val, origin, direction, maxDist, refinement);
+      if (t && (!retval || *t < retval->distance)) {
+        retval = RayHit{std::get<ValueTypes::ItemType>(val), *t};
+      }
+    }
+    this->countCandidates(candidates);
+
+    return retval;
+  }
+
+private:
+  /**\brief all Items we store by its bounding boxes, BUT! bounding boxes
+   * defined in Items koordinates (without rotating), so we need translate it to
+   * Scene koordinates
+   */
+  static Box getSceneBoundingBox(const AbstractItem &item) noexcept {
+    Box   itemBoundingBox = item.getBoundingBox();
+    Point itemScenePos    = item.getScenePos();
+
+    Box sceneBoundingBox;
+    bg::transform(itemBoundingBox,
+                  sceneBoundingBox,
+                  TranslateStrategy{itemScenePos.x(), itemScenePos.y()});
+    return sceneBoundingBox;
+  }
+
+  /**\brief set new box for the value in values_ and remember old and new
+   * value for updating of the tree
+   */
+  void moveValue(Value &val) {
+    const ItemPtr &item = std::get<ValueTypes::ItemType>(val);
+
+    oldValues_.emplace_back(val);
+    std::get<ValueTypes::BoxType>(val) = getSceneBoundingBox(*item);
+    newValues_.emplace_back(val);
+
+    this->touch(item.get());
+  }
+
+  /**\brief remember the Item as changed for all snapshots. Does nothing if
+   * snapshots were never requested
+   */
+  void touch(const AbstractItem *item) {
+    if (buffers_) {
+      buffers_->changed[item] = 0b11;
+    }
+  }
+
+  /**\brief rebuild the snapshot from current state of the Scene
+   */
+  void rebuildSnapshot(SceneSnapshotImp &snapshot) const;
+
+  /**\brief update the snapshot only by Items changed for the slot. Bit of
+   * the slot is cleared for all changed Items
+   */
+  void updateSnapshot(SceneSnapshotImp &snapshot, uint8_t slotBit);
+
+  /**\brief remove values of all subtrees, which root Items intersect the
+   * region, from the tree
+   *
+   * \return removed values (include values of children)
+   */
+  std::vector<Value> takeSubtrees(Box region, ItemList &roots) {
+    tree_.query(bg::index::intersects(region) &&
+                    bg::index::satisfies([](const Value &val) {
+                      return std::get<ValueTypes::ItemType>(val)
+                                 ->getParent() == nullptr;
+                    }),
+                boost::make_function_output_iterator(
+                    [&roots](const Value &val) {
+                      roots.emplace_back(std::get<ValueTypes::ItemType>(val));
+                    }));
+
+    std::vector<Value> values;
+    auto               takeValue = [this, &values](const ItemPtr &item) {
+      auto found = values_.find(item.get());
+      DEBBUG_ASSERT(found != values_.end(), "item of subtree not found");
+      values.emplace_back(std::move(found->second));
+      values_.erase(found);
+
+      this->touch(item.get());
+    };
+
+    for (ItemPtr &root : roots) {
+      takeValue(root);
+      forEachDescendant(root.get(), takeValue);
+    }
+
+    if (values.size() * BULK_REPACK_DIVISOR >= tree_.size()) {
+      this->repack();
+    } else {
+      for (const Value &val : values) {
+        tree_.remove(val);
+      }
+    }
+
+    return values;
+  }
+
+  /**\brief insert several values at once
+   */
+  void appendValues(std::vector<Value> values) {
+    bool needRepack = values.size() * BULK_REPACK_DIVISOR >= tree_.size();
+
+    if (needRepack == false) {
+      tree_.insert(values.begin(), values.end());
+    }
+
+    for (Value &val : values) {
+      const AbstractItem *key = std::get<ValueTypes::ItemType>(val).get();
+      values_[key]            = std::move(val);
+
+      this->touch(key);
+    }
+
+    if (needRepack) {
+      this->repack();
+    }
+  }
+
+  /**\brief rebuild the tree from all values by packing algorithm
+   */
+  void repack() {
+    std::pmr::vector<Value> all{tree_.get_allocator().resource()};
+    all.reserve(values_.size());
+    for (const auto &[key, val] : values_) {
+      all.emplace_back(val);
+    }
+
+    // XXX the tree must use same allocator, otherwise it will be copied on
+    // assignment
+    tree_ = RTree{all.begin(),
+                  all.end(),
+                  Index{},
+                  {},
+                  {},
+                  tree_.get_allocator()};
+  }
+
+  /**\return parameter of the ray for first intersection with the Item, or
+   * nothing if the ray misses the Item
+   */
+  std::optional<float> castOnValue(const Value &     val,
+                                   Point             origin,
+                                   Point             direction,
+                                   float             tMax,
+                                   Scene::Refinement refinement) const
+      noexcept {
+    std::optional<float> t = rayBoxEntry(
+        origin, direction, tMax, std::get<ValueTypes::BoxType>(val));
+
+    if (t && refinement == Scene::Refinement::BoundingShape) {
+      // check the ray in item koordinates, so the parameter of the ray stays
+      // same
+      const ItemPtr &item             = std::get<ValueTypes::ItemType>(val);
+      Affine         inverseTransform = inverse(item->getSceneTransform());
+
+      t = rayBoxEntry(transformPoint(inverseTransform, origin),
+                      transformVector(inverseTransform, direction),
+                      tMax,
+                      item->getBoundingBox());
+    }
+
+    return t;
+  }
+
+  /**\return true if the box has the spatial relation with the geometry
+   */
+  template <typename GeometryType>
+  static bool relate(const Box &         box,
+                     const GeometryType &geometry,
+                     Scene::SpatialIndex index) noexcept {
+    switch (index) {
+    case Scene::SpatialIndex::Intersects:
+      return bg::intersects(box, geometry);
+    case Scene::SpatialIndex::Within: {
+      // XXX relation box-polygon is not implemented for `within`, so convert
+      // the box to ring
+      Ring boxRing;
+      bg::convert(box, boxRing);
+      if constexpr (std::is_same<GeometryType, MultiPolygon>::value) {
+        // XXX polygons of valid multi polygon can touch each other only in
+        // points, so the box can be within only one of them. Also boost
+        // relation with multi polygon computes its envelope, which produces
+        // maybe-uninitialized warnings in release builds
+        return std::any_of(geometry.begin(),
+                           geometry.end(),
+                           [&boxRing](const Polygon &polygon) {
+                             return bg::within(boxRing, polygon);
+                           });
+      } else {
+        return bg::within(boxRing, geometry);
+      }
+    }
+    }
+
+    return false;
+  }
+
+  /**\brief call the callback for every value, which covers the point
+   */
+  template <typename Callback>
+  void visit(Point pos, ItemFilter filter, Callback callback) const {
+    this->filteredQuery(bg::index::covers(pos),
+                        filter,
+                        boost::make_function_output_iterator(callback));
+  }
+
+  /**\brief call the callback for every value, which relates with the geometry
+   */
+  template <typename GeometryType, typename Callback>
+  void visit(const GeometryType &geometry,
+             Scene::SpatialIndex index,
+             ItemFilter          filter,
+             Callback            callback) const {
     if constexpr (std::is_same<GeometryType, Box>::value) {
+      auto inserter = boost::make_function_output_iterator(callback);
+
+      switch (index) {
+      case Scene::SpatialIndex::Intersects:
+        this->filteredQuery(bg::index::intersects(geometry), filter, inserter);
+        break;
+      case Scene::SpatialIndex::Within:
+        this->filteredQuery(bg::index::within(geometry), filter, inserter);
+        break;
+      }
+    } else {
+      // XXX polygons can be non-convex and can have holes, so checking them
+      // against every node of the tree is expensive. So we traverse the tree
+      // by envelope of the geometry and check exact relation only for found
+      // values
+      if constexpr (std::is_same<GeometryType, MultiPolygon>::value) {
+        if (geometry.empty()) {
+          return;
+        }
+      }
+      Box envelope = envelopeOf(geometry);
+
+      auto checked_inserter = boost::make_function_output_iterator(
+          [&callback, &geometry, index](const Value &val) {
+            if (relate(std::get<ValueTypes::BoxType>(val), geometry, index)) {
+              callback(val);
+            }
+          });
+
       switch (index) {
       case Scene::SpatialIndex::Intersects:
-        tree_.query(bg::index::intersects(geometry), back_inserter);
+        this->filteredQuery(
+            bg::index::intersects(envelope), filter, checked_inserter);
         break;
       case Scene::SpatialIndex::Within:
-        tree_.query(bg::index::within(geometry), back_inserter);
+        this->filteredQuery(
+            bg::index::within(envelope), filter, checked_inserter);
         break;
       }
+    }
+  }
+
+  /**\return predicate, which checks flags of Item by the filter
+   */
+  static auto flagsPredicate(ItemFilter filter) noexcept {
+    return bg::index::satisfies([filter](const Value &val) {
+      return filter.accept(std::get<ValueTypes::FlagsType>(val));
+    });
+  }
+
+  /**\brief add the filter to spatial predicates, so flags of Items are checked
+   * while traversing the tree. Empty filter doesn't add any checks
+   */
+  template <typename Predicates, typename OutputIterator>
+  void filteredQuery(Predicates     predicates,
+                     ItemFilter     filter,
+                     OutputIterator out) const {
+    size_t candidates = 0;
+    if (filter.empty()) {
+      candidates = tree_.query(predicates, out);
     } else {
-      tree_.query(bg::index::intersects(geometry), back_inserter);
+      candidates = tree_.query(predicates && flagsPredicate(filter), out);
     }
 
-    return retval;
+    this->countCandidates(candidates);
+  }
+
+  /**\brief append count of values found by query to statistic
+   */
+  void countCandidates([[maybe_unused]] size_t candidates) const noexcept {
+#ifdef SVC_SCENE_STATS
+    if (stats_) {
+      stats_->countCandidates(SceneOperation::Query, candidates);
+    }
+#endif
+  }
+
+  /**\brief same as filteredQuery, but for iterative traversing
+   */
+  template <typename Predicates>
+  RTree::const_query_iterator filteredQueryBegin(Predicates predicates,
+                                                 ItemFilter filter) const {
+    if (filter.empty()) {
+      return tree_.qbegin(predicates);
+    }
+    return tree_.qbegin(predicates && flagsPredicate(filter));
   }
 
 private:
-  RTree tree_;
+  /**\return size and alignment of node of ValueMap
+   */
+  static std::pair<size_t, size_t> getMapNodeSize() {
+    NodeSizeProbe probe;
+    ValueMap      map{&probe};
+    map.reserve(1);
+
+    probe.reset();
+    map.emplace(nullptr, Value{Box{Point{0, 0}, Point{0, 0}}, nullptr, 0});
+    return {probe.size, probe.alignment};
+  }
+
+  /**\return size and alignment of node of RTree, leafs and internal nodes
+   * have same size
+   */
+  static std::pair<size_t, size_t> getTreeNodeSize() {
+    NodeSizeProbe probe;
+    RTree         tree{Index{}, {}, {}, Allocator{&probe}};
+
+    tree.insert(Value{Box{Point{0, 0}, Point{0, 0}}, nullptr, 0});
+    return {probe.size, probe.alignment};
+  }
+
+private:
+  /// not set if resource was provided by user
+  std::unique_ptr<std::pmr::memory_resource> ownResource_;
+
+  RTree    tree_;
+  ValueMap values_;
+
+  /// created by first request of snapshot
+  std::unique_ptr<SnapshotBuffers> buffers_;
+
+  /// buffers of updateSubtreePosition
+  std::pmr::vector<Value> oldValues_;
+  std::pmr::vector<Value> newValues_;
+
+#ifdef SVC_SCENE_STATS
+  /// not set for indexes of snapshots
+  std::unique_ptr<SceneStatsRecorder> stats_;
+#endif
 };
 
+class SceneSnapshotImp {
+public:
+  /**\brief snapshot is destroyed by reader thread, so it can not use resource
+   * of the Scene
+   */
+  SceneSnapshotImp() noexcept
+      : index_{std::pmr::new_delete_resource()} {
+  }
+
+  /// contains copies of values from the Scene
+  SceneImp index_;
+
+  /// Scene transformations of Items at the moment of taking the snapshot
+  std::unordered_map<const AbstractItem *, Affine> matrices_;
+};
+
+SceneSnapshotPtr SceneImp::snapshot() {
+  if (buffers_ == nullptr) {
+    buffers_ =
+        std::make_unique<SnapshotBuffers>(values_.get_allocator().resource());
+  }
+
+  int                    slotIndex = buffers_->back;
+  SnapshotBuffers::Slot &slot      = buffers_->slots[slotIndex];
+  buffers_->back ^= 1;
+
+  // XXX if the snapshot from the slot is still used by some reader, then we
+  // can not change it, so it is retired and other snapshot is used. Acquire
+  // load synchronizes with releasing of the snapshot by reader
+  if (slot.holder != nullptr &&
+      slot.holder->state.load(std::memory_order_acquire) !=
+          SnapshotHolder::Free) {
+    buffers_->retired.emplace_back(slot.holder);
+    slot.holder = nullptr;
+  }
+  if (slot.holder == nullptr) {
+    slot.holder = buffers_->takeFree();
+    if (slot.holder == nullptr) {
+      slot.holder = new SnapshotHolder;
+      slot.holder->snapshot.reset(new SceneSnapshot{});
+    }
+    slot.needRebuild = true;
+  }
+
+  uint8_t slotBit = 1 << slotIndex;
+  if (slot.needRebuild) {
+    this->rebuildSnapshot(*slot.holder->snapshot->imp_);
+
+    for (auto iter = buffers_->changed.begin();
+         iter != buffers_->changed.end();) {
+      if ((iter->second &= ~slotBit) == 0) {
+        iter = buffers_->changed.erase(iter);
+      } else {
+        ++iter;
+      }
+    }
+  } else {
+    this->updateSnapshot(*slot.holder->snapshot->imp_, slotBit);
+  }
+  slot.needRebuild = false;
+
+  slot.holder->state.store(SnapshotHolder::InUse, std::memory_order_relaxed);
+  return SceneSnapshotPtr{slot.holder->snapshot.get(),
+                          SnapshotHolder::Releaser{slot.holder}};
+}
+
+void SceneImp::rebuildSnapshot(SceneSnapshotImp &snapshot) const {
+  snapshot.index_.tree_   = tree_;
+  snapshot.index_.values_ = values_;
+
+  snapshot.matrices_.clear();
+  for (const auto &[key, val] : values_) {
+    snapshot.matrices_[key] =
+        std::get<ValueTypes::ItemType>(val)->getSceneTransform();
+  }
+}
+
+void SceneImp::updateSnapshot(SceneSnapshotImp &snapshot, uint8_t slotBit) {
+  SceneImp &index = snapshot.index_;
+
+  for (auto iter = buffers_->changed.begin();
+       iter != buffers_->changed.end();) {
+    auto &[key, bits] = *iter;
+    if (bits & slotBit) {
+      if (auto found = index.values_.find(key); found != index.values_.end()) {
+        index.tree_.remove(found->second);
+        index.values_.erase(found);
+        snapshot.matrices_.erase(key);
+      }
+
+      // XXX changed Item can be already removed from the Scene
+      if (auto found = values_.find(key); found != values_.end()) {
+        index.tree_.insert(found->second);
+        index.values_.emplace(key, found->second);
+        snapshot.matrices_.emplace(
+            key,
+            std::get<ValueTypes::ItemType>(found->second)
+                ->getSceneTransform());
+      }
+    }
+
+    if ((bits &= ~slotBit) == 0) {
+      iter = buffers_->changed.erase(iter);
+    } else {
+      ++iter;
+    }
+  }
+}
+
+const char *toString(Status status) noexcept {
+  switch (status) {
+  case Status::Ok:
+    return "ok";
+  case Status::InvalidArgument:
+    return "invalid argument";
+  case Status::NotFound:
+    return "item not found";
+  case Status::NotIndexed:
+    return "item not found in index";
+  }
+  return "";
+}
+
 Scene::Scene() noexcept
-    : imp_{new SceneImp{}} {
+    : imp_{} {
+#ifdef SVC_SCENE_STATS
+  imp_->enableStats();
+#endif
+}
+
+Scene::Scene(std::pmr::memory_resource *resource) noexcept
+    : imp_{resource} {
+#ifdef SVC_SCENE_STATS
+  imp_->enableStats();
+#endif
 }
 
 Scene::~Scene() noexcept {
   std::for_each(imp_->begin(), imp_->end(), [](const ItemPtr &item) {
     item->setScene(nullptr);
   });
-
-  delete imp_;
-}
-
-static void recursiveChildCall(std::function<void(ItemPtr &)> foo,
-                               AbstractItem *                 item) {
-  std::list<ItemPtr> children = item->getChildren();
-  for_each(children.begin(), children.end(), [foo](ItemPtr &child) {
-    foo(child);
-    recursiveChildCall(foo, child.get());
-  });
 }
 
 void Scene::appendItem(ItemPtr &item) {
@@ -233,6 +1402,9 @@ void Scene::appendItem(ItemPtr &item) {
     LOG_THROW(std::runtime_error, "can't append invalid item");
   }
 
+  TRACE_SCOPE("Scene::appendItem");
+  SCENE_STATS_SCOPE(SceneOperation::Append);
+
   if (AbstractItem *parent = item->getParent();
       parent && parent->getScene() != this) {
     parent->removeChild(item.get()); // also remove the item from another Scene
@@ -244,44 +1416,93 @@ void Scene::appendItem(ItemPtr &item) {
   imp_->appendItem(item);
   item->setScene(this);
 
-  recursiveChildCall(
-      [this](ItemPtr &child) {
-        this->imp_->appendItem(child);
-        child->setScene(this);
-      },
-      item.get());
+  forEachDescendant(item.get(), [this](const ItemPtr &child) {
+    this->imp_->appendItem(child);
+    child->setScene(this);
+  });
 }
 
 void Scene::removeItem(AbstractItem *item) {
+  if (Status status = this->tryRemoveItem(item); status != Status::Ok) {
+    LOG_THROW(std::runtime_error, "can't remove item: %1%", toString(status));
+  }
+}
+
+Status Scene::tryRemoveItem(AbstractItem *item) {
   if (item == nullptr) {
-    LOG_THROW(std::runtime_error, "can't append invalid item");
+    return Status::InvalidArgument;
   }
+  if (item->getScene() != this) {
+    return Status::NotFound;
+  }
+
+  TRACE_SCOPE("Scene::removeItem");
+  SCENE_STATS_SCOPE(SceneOperation::Remove);
 
   // XXX before removing the Item from children we need set its scene as nullptr
   // for prevent don't call the function recursively
   item->setScene(nullptr);
+  Status status = Status::Ok;
   if (AbstractItem *parentItem = item->getParent()) {
-    parentItem->removeChild(item);
+    status = firstFailure(status, parentItem->tryRemoveChild(item));
   }
 
-  imp_->removeItem(item);
+  status = firstFailure(status, imp_->removeItem(item));
+
+  forEachDescendant(item, [this, &status](const ItemPtr &child) {
+    status = firstFailure(status, this->imp_->removeItem(child.get()));
+    child->setScene(nullptr);
+  });
 
-  recursiveChildCall(
-      [this](ItemPtr &child) {
-        this->imp_->removeItem(child.get());
-        child->setScene(nullptr);
-      },
-      item);
+  return status;
 }
 
 void Scene::updateItemPosition(AbstractItem *item) {
-  imp_->updateItemPosition(item);
+  if (Status status = this->tryUpdateItemPosition(item);
+      status != Status::Ok) {
+    LOG_THROW(std::runtime_error,
+              "can't update item position: %1%",
+              toString(status));
+  }
+}
 
-  recursiveChildCall(
-      [this](ItemPtr &child) {
-        this->imp_->updateItemPosition(child.get());
-      },
-      item);
+Status Scene::tryUpdateItemPosition(AbstractItem *item) {
+  if (item == nullptr) {
+    return Status::InvalidArgument;
+  }
+
+  TRACE_SCOPE("Scene::updateItemPosition");
+  SCENE_STATS_SCOPE(SceneOperation::Update);
+
+  return imp_->updateSubtreePosition(item);
+}
+
+void Scene::setItemFlags(AbstractItem *item, ItemFlags flags) {
+  imp_->setItemFlags(item, flags);
+}
+
+ItemFlags Scene::getItemFlags(AbstractItem *item) const {
+  return imp_->getItemFlags(item);
+}
+
+ItemList Scene::extract(Box region) {
+  TRACE_SCOPE("Scene::extract");
+
+  return imp_->extract(region);
+}
+
+void Scene::transferFrom(Scene &source, Box region) {
+  TRACE_SCOPE("Scene::transferFrom");
+
+  if (&source == this) {
+    return;
+  }
+
+  imp_->transferFrom(*source.imp_, region, this);
+}
+
+void Scene::reserve(size_t n) {
+  imp_->reserve(n);
 }
 
 size_t Scene::count() const noexcept {
@@ -304,19 +1525,191 @@ Box Scene::bounds() const noexcept {
   return imp_->bounds();
 }
 
-ItemList Scene::query(Point pos) const noexcept {
-  return imp_->query(pos);
+ItemList Scene::query(Point pos, ItemFilter filter) const noexcept {
+  TRACE_SCOPE("Scene::query");
+  SCENE_STATS_SCOPE(SceneOperation::Query);
+  ItemList retval = imp_->query(pos, filter);
+  SCENE_STATS_HITS(retval.size());
+
+  return retval;
+}
+
+ItemList Scene::query(Box box, SpatialIndex index, ItemFilter filter) const
+    noexcept {
+  TRACE_SCOPE("Scene::query");
+  SCENE_STATS_SCOPE(SceneOperation::Query);
+  ItemList retval = imp_->query(box, index, filter);
+  SCENE_STATS_HITS(retval.size());
+
+  return retval;
+}
+
+void Scene::query(Point pos, ItemBuffer &out, ItemFilter filter) const
+    noexcept {
+  TRACE_SCOPE("Scene::query");
+  SCENE_STATS_SCOPE(SceneOperation::Query);
+  imp_->query(pos, out, filter);
+  SCENE_STATS_HITS(out.size());
+}
+
+void Scene::query(Box          box,
+                  ItemBuffer & out,
+                  SpatialIndex index,
+                  ItemFilter   filter) const noexcept {
+  TRACE_SCOPE("Scene::query");
+  SCENE_STATS_SCOPE(SceneOperation::Query);
+  imp_->query(box, out, index, filter);
+  SCENE_STATS_HITS(out.size());
+}
+
+void Scene::query(const Ring & ring,
+                  ItemBuffer & out,
+                  SpatialIndex index,
+                  ItemFilter   filter) const noexcept {
+  DEBBUG_ASSERT(bg::is_valid(ring), "ring must be valid");
+
+  TRACE_SCOPE("Scene::query");
+  SCENE_STATS_SCOPE(SceneOperation::Query);
+  imp_->query(ring, out, index, filter);
+  SCENE_STATS_HITS(out.size());
+}
+
+void Scene::query(const Ring &       ring,
+                  SharedItemBuffer & out,
+                  SpatialIndex       index,
+                  ItemFilter         filter) const noexcept {
+  DEBBUG_ASSERT(bg::is_valid(ring), "ring must be valid");
+
+  TRACE_SCOPE("Scene::query");
+  SCENE_STATS_SCOPE(SceneOperation::Query);
+  imp_->query(ring, out, index, filter);
+  SCENE_STATS_HITS(out.size());
+}
+
+void Scene::query(const Polygon &polygon,
+                  ItemBuffer &   out,
+                  SpatialIndex   index,
+                  ItemFilter     filter) const noexcept {
+  DEBBUG_ASSERT(bg::is_valid(polygon), "polygon must be valid");
+
+  TRACE_SCOPE("Scene::query");
+  SCENE_STATS_SCOPE(SceneOperation::Query);
+  imp_->query(polygon, out, index, filter);
+  SCENE_STATS_HITS(out.size());
+}
+
+void Scene::query(const MultiPolygon &multiPolygon,
+                  ItemBuffer &        out,
+                  SpatialIndex        index,
+                  ItemFilter          filter) const noexcept {
+  DEBBUG_ASSERT(bg::is_valid(multiPolygon), "multi polygon must be valid");
+
+  TRACE_SCOPE("Scene::query");
+  SCENE_STATS_SCOPE(SceneOperation::Query);
+  imp_->query(multiPolygon, out, index, filter);
+  SCENE_STATS_HITS(out.size());
+}
+
+ItemList Scene::query(Ring ring, SpatialIndex index, ItemFilter filter) const
+    noexcept {
+  DEBBUG_ASSERT(bg::is_valid(ring), "ring must be valid");
+
+  TRACE_SCOPE("Scene::query");
+  SCENE_STATS_SCOPE(SceneOperation::Query);
+  ItemList retval = imp_->query(ring, index, filter);
+  SCENE_STATS_HITS(retval.size());
+
+  return retval;
+}
+
+ItemList Scene::query(Polygon polygon, SpatialIndex index, ItemFilter filter)
+    const noexcept {
+  DEBBUG_ASSERT(bg::is_valid(polygon), "polygon must be valid");
+
+  TRACE_SCOPE("Scene::query");
+  SCENE_STATS_SCOPE(SceneOperation::Query);
+  ItemList retval = imp_->query(polygon, index, filter);
+  SCENE_STATS_HITS(retval.size());
+
+  return retval;
 }
 
-ItemList Scene::query(Box box, SpatialIndex index) const noexcept {
-  return imp_->query(box, index);
+ItemList Scene::query(MultiPolygon multiPolygon,
+                      SpatialIndex index,
+                      ItemFilter   filter) const noexcept {
+  DEBBUG_ASSERT(bg::is_valid(multiPolygon), "multi polygon must be valid");
+
+  TRACE_SCOPE("Scene::query");
+  SCENE_STATS_SCOPE(SceneOperation::Query);
+  ItemList retval = imp_->query(multiPolygon, index, filter);
+  SCENE_STATS_HITS(retval.size());
+
+  return retval;
+}
+
+ItemList Scene::queryRadius(Point      center,
+                            float      radius,
+                            ItemFilter filter) const noexcept {
+  TRACE_SCOPE("Scene::queryRadius");
+  SCENE_STATS_SCOPE(SceneOperation::Query);
+  ItemList retval = imp_->queryRadius(center, radius, filter);
+  SCENE_STATS_HITS(retval.size());
+
+  return retval;
+}
+
+ItemList Scene::queryRadiusSorted(Point      center,
+                                  float      radius,
+                                  ItemFilter filter) const noexcept {
+  TRACE_SCOPE("Scene::queryRadiusSorted");
+  SCENE_STATS_SCOPE(SceneOperation::Query);
+  ItemList retval = imp_->queryRadiusSorted(center, radius, filter);
+  SCENE_STATS_HITS(retval.size());
+
+  return retval;
+}
+
+ItemList Scene::query(Segment    segment,
+                      ItemFilter filter,
+                      Refinement refinement) const noexcept {
+  TRACE_SCOPE("Scene::query");
+  SCENE_STATS_SCOPE(SceneOperation::Query);
+  ItemList retval = imp_->query(segment, filter, refinement);
+  SCENE_STATS_HITS(retval.size());
+
+  return retval;
+}
+
+std::optional<RayHit> Scene::raycast(Point      origin,
+                                     Point      direction,
+                                     float      maxDist,
+                                     ItemFilter filter,
+                                     Refinement refinement) const noexcept {
+  TRACE_SCOPE("Scene::raycast");
+  SCENE_STATS_SCOPE(SceneOperation::Query);
+  std::optional<RayHit> retval =
+      imp_->raycast(origin, direction, maxDist, filter, refinement);
+  SCENE_STATS_HITS(retval ? 1 : 0);
+
+  return retval;
+}
+
+SceneStats Scene::stats([[maybe_unused]] bool reset) noexcept {
+#ifdef SVC_SCENE_STATS
+  return imp_->getStatsRecorder()->get(reset);
+#else
+  return SceneStats{};
+#endif
 }
 
-ItemList Scene::query(Ring ring, SpatialIndex index) const noexcept {
-  DEBBUG_ASSERT(bg::is_valid(ring) && bg::is_convex(ring),
-                "ring must be valid convex ring");
+SceneSnapshotPtr Scene::snapshot() {
+  TRACE_SCOPE("Scene::snapshot");
 
-  return imp_->query(ring, index);
+  return imp_->snapshot();
+}
+
+void Scene::updateItemTransform(AbstractItem *item) noexcept {
+  imp_->touchSubtree(item);
 }
 
 void Scene::accept(AbstractVisitor *visitor) {
@@ -326,6 +1719,73 @@ void Scene::accept(AbstractVisitor *visitor) {
     }
   });
 }
+
+SceneSnapshot::SceneSnapshot() noexcept
+    : imp_{new SceneSnapshotImp{}} {
+}
+
+SceneSnapshot::~SceneSnapshot() noexcept {
+  delete imp_;
+}
+
+size_t SceneSnapshot::count() const noexcept {
+  return imp_->index_.count();
+}
+
+bool SceneSnapshot::empty() const noexcept {
+  return imp_->index_.empty();
+}
+
+Box SceneSnapshot::bounds() const noexcept {
+  return imp_->index_.bounds();
+}
+
+ItemList SceneSnapshot::query(Point pos, ItemFilter filter) const noexcept {
+  return imp_->index_.query(pos, filter);
+}
+
+ItemList SceneSnapshot::query(Box                 box,
+                              Scene::SpatialIndex index,
+                              ItemFilter          filter) const noexcept {
+  return imp_->index_.query(box, index, filter);
+}
+
+ItemList SceneSnapshot::query(Ring                ring,
+                              Scene::SpatialIndex index,
+                              ItemFilter          filter) const noexcept {
+  DEBBUG_ASSERT(bg::is_valid(ring), "ring must be valid");
+
+  return imp_->index_.query(ring, index, filter);
+}
+
+void SceneSnapshot::query(Point pos, ItemBuffer &out, ItemFilter filter) const
+    noexcept {
+  imp_->index_.query(pos, out, filter);
+}
+
+void SceneSnapshot::query(Box                 box,
+                          ItemBuffer &        out,
+                          Scene::SpatialIndex index,
+                          ItemFilter          filter) const noexcept {
+  imp_->index_.query(box, out, index, filter);
+}
+
+void SceneSnapshot::query(const Ring &        ring,
+                          ItemBuffer &        out,
+                          Scene::SpatialIndex index,
+                          ItemFilter          filter) const noexcept {
+  DEBBUG_ASSERT(bg::is_valid(ring), "ring must be valid");
+
+  imp_->index_.query(ring, out, index, filter);
+}
+
+std::optional<Matrix>
+SceneSnapshot::getSceneMatrix(const AbstractItem *item) const noexcept {
+  if (auto found = imp_->matrices_.find(item); found != imp_->matrices_.end()) {
+    return toMatrix(found->second);
+  }
+  return std::nullopt;
+}
 } // namespace svc
 
 namespace std {
@@ -0,0 +1,216 @@
+// SceneStats.cpp
+
+#include "svc/SceneStats.hpp"
+#include "logs.hpp"
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+namespace svc {
+size_t LatencyHistogram::bucketIndex(uint64_t value) noexcept {
+  if (value < SubBucketsCount) {
+    return value;
+  }
+
+  size_t magnitude = 63 - __builtin_clzll(value);
+  size_t shift     = magnitude - SubBucketBits;
+  size_t sub       = (value >> shift) & (SubBucketsCount - 1);
+
+  return SubBucketsCount + shift * SubBucketsCount + sub;
+}
+
+uint64_t LatencyHistogram::bucketLowerBound(size_t index) noexcept {
+  if (index < SubBucketsCount) {
+    return index;
+  }
+
+  size_t shift = (index - SubBucketsCount) / SubBucketsCount;
+  size_t sub   = (index - SubBucketsCount) % SubBucketsCount;
+
+  return uint64_t(SubBucketsCount + sub) << shift;
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(size_t index) noexcept {
+  if (index < SubBucketsCount) {
+    return index;
+  }
+
+  size_t shift = (index - SubBucketsCount) / SubBucketsCount;
+
+  return bucketLowerBound(index) + ((uint64_t(1) << shift) - 1);
+}
+
+LatencyHistogram::LatencyHistogram() noexcept
+    : buckets_{}
+    , count_{0}
+    , sum_{0}
+    , min_{std::numeric_limits<uint64_t>::max()}
+    , max_{0} {
+}
+
+void LatencyHistogram::record(uint64_t value) noexcept {
+  ++buckets_[bucketIndex(value)];
+  ++count_;
+  sum_ += value;
+  min_ = std::min(min_, value);
+  max_ = std::max(max_, value);
+}
+
+uint64_t LatencyHistogram::percentile(double q) const noexcept {
+  if (count_ == 0) {
+    return 0;
+  }
+
+  uint64_t rank = std::max<uint64_t>(1, uint64_t(q * count_ + 0.5));
+
+  uint64_t accumulated = 0;
+  for (size_t i = 0; i < BucketsCount; ++i) {
+    accumulated += buckets_[i];
+    if (accumulated >= rank) {
+      return std::min(bucketUpperBound(i), max_);
+    }
+  }
+
+  return max_;
+}
+
+uint64_t LatencyHistogram::count() const noexcept {
+  return count_;
+}
+
+uint64_t LatencyHistogram::sum() const noexcept {
+  return sum_;
+}
+
+uint64_t LatencyHistogram::min() const noexcept {
+  return count_ != 0 ? min_ : 0;
+}
+
+uint64_t LatencyHistogram::max() const noexcept {
+  return max_;
+}
+
+const LatencyHistogram::Buckets &LatencyHistogram::buckets() const noexcept {
+  return buckets_;
+}
+
+const char *toString(SceneOperation operation) noexcept {
+  switch (operation) {
+  case SceneOperation::Append:
+    return "append";
+  case SceneOperation::Remove:
+    return "remove";
+  case SceneOperation::Update:
+    return "update";
+  case SceneOperation::Query:
+    return "query";
+  case SceneOperation::Count_:
+    break;
+  }
+  return "";
+}
+
+const OperationStats &
+SceneStats::operator[](SceneOperation operation) const noexcept {
+  return operations[size_t(operation)];
+}
+
+static void writeJson(std::ostream &out, const SceneStats &stats) {
+  out << "{\n";
+  out << "  \"enabled\": " << (stats.enabled ? "true" : "false") << ",\n";
+  out << "  \"operations\": {";
+
+  for (size_t i = 0; i < stats.operations.size(); ++i) {
+    const OperationStats &  op      = stats.operations[i];
+    const LatencyHistogram &latency = op.latency;
+
+    out << (i == 0 ? "\n" : ",\n");
+    out << "    \"" << toString(SceneOperation(i)) << "\": {";
+    out << "\"count\": " << op.count;
+    out << ", \"candidates\": " << op.candidates;
+    out << ", \"hits\": " << op.hits;
+    out << ", \"latency_ns\": {";
+    out << "\"min\": " << latency.min();
+    out << ", \"p50\": " << latency.percentile(0.5);
+    out << ", \"p90\": " << latency.percentile(0.9);
+    out << ", \"p99\": " << latency.percentile(0.99);
+    out << ", \"p999\": " << latency.percentile(0.999);
+    out << ", \"max\": " << latency.max();
+    out << ", \"sum\": " << latency.sum();
+    out << "}}";
+  }
+
+  out << "\n  }\n";
+  out << "}\n";
+}
+
+/**\note latency histogram is written as cumulative histogram with only not
+ * empty buckets, because Prometheus doesn't need all 976 buckets
+ */
+static void writePrometheus(std::ostream &out, const SceneStats &stats) {
+  const std::pair<const char *, uint64_t OperationStats::*> counters[] = {
+      {"svc_scene_operations_total", &OperationStats::count},
+      {"svc_scene_candidates_total", &OperationStats::candidates},
+      {"svc_scene_hits_total", &OperationStats::hits},
+  };
+
+  for (const auto &[name, member] : counters) {
+    out << "# TYPE " << name << " counter\n";
+    for (size_t i = 0; i < stats.operations.size(); ++i) {
+      out << name << "{operation=\"" << toString(SceneOperation(i)) << "\"} "
+          << stats.operations[i].*member << '\n';
+    }
+  }
+
+  const char *histogram = "svc_scene_latency_nanoseconds";
+  out << "# TYPE " << histogram << " histogram\n";
+  for (size_t i = 0; i < stats.operations.size(); ++i) {
+    const char *            operation = toString(SceneOperation(i));
+    const LatencyHistogram &latency   = stats.operations[i].latency;
+
+    uint64_t accumulated = 0;
+    for (size_t j = 0; j < LatencyHistogram::BucketsCount; ++j) {
+      if (latency.buckets()[j] == 0) {
+        continue;
+      }
+
+      accumulated += latency.buckets()[j];
+      out << histogram << "_bucket{operation=\"" << operation << "\",le=\""
+          << LatencyHistogram::bucketUpperBound(j) << "\"} " << accumulated
+          << '\n';
+    }
+    out << histogram << "_bucket{operation=\"" << operation
+        << "\",le=\"+Inf\"} " << latency.count() << '\n';
+    out << histogram << "_sum{operation=\"" << operation << "\"} "
+        << latency.sum() << '\n';
+    out << histogram << "_count{operation=\"" << operation << "\"} "
+        << latency.count() << '\n';
+  }
+}
+
+void SceneStats::write(std::ostream &out, Format format) const {
+  switch (format) {
+  case Format::Json:
+    writeJson(out, *this);
+    break;
+  case Format::Prometheus:
+    writePrometheus(out, *this);
+    break;
+  }
+}
+
+void SceneStats::dump(const std::string &fileName, Format format) const {
+  std::ofstream fout{fileName, std::ios::out | std::ios::trunc};
+  if (fout.is_open() == false) {
+    LOG_THROW(std::runtime_error, "can not open file %1%", fileName);
+  }
+
+  this->write(fout, format);
+
+  fout.close();
+  if (fout.fail()) {
+    LOG_THROW(std::runtime_error, "can not write file %1%", fileName);
+  }
+}
+} // namespace svc
@@ -0,0 +1,29 @@
+// throw_exception.cpp
+/**\file if Boost is used without exceptions (`BOOST_NO_EXCEPTIONS`), then user
+ * must provide handlers for errors, which Boost reports by exceptions
+ */
+
+#ifdef BOOST_NO_EXCEPTIONS
+
+#  include "logs.hpp"
+#  include <boost/throw_exception.hpp>
+#  include <cstdlib>
+
+namespace boost {
+void throw_exception(const std::exception &e) {
+  LOG_FORMAT(logs::Severity::Throw, logs::messageHandler("%1%", e.what()));
+  std::abort();
+}
+
+void throw_exception(const std::exception &        e,
+                     const boost::source_location &loc) {
+  LOG_FORMAT(logs::Severity::Throw,
+             logs::messageHandler("%1% (%2%:%3%)",
+                                  e.what(),
+                                  loc.file_name(),
+                                  loc.line()));
+  std::abort();
+}
+} // namespace boost
+
+#endif
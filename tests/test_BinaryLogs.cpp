@@ -0,0 +1,172 @@
+// test_BinaryLogs.cpp
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch.hpp>
+
+//
+
+#include "binary_logs.hpp"
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#define TEST_LOG_FILE "test_binary_logs.blog"
+
+struct DecodedRecord {
+  logs::Severity   severity;
+  std::string      functionName;
+  uint64_t         threadId;
+  std::string      message;
+  std::chrono::time_point<std::chrono::system_clock> timePoint;
+};
+
+/**\brief content of binary log file and its records
+ */
+struct DecodedLog {
+  logs::binary::FileHeader   header;
+  std::vector<DecodedRecord> records;
+  size_t                     invalid;
+};
+
+static DecodedLog decodeFile(const std::string &fileName) {
+  std::ifstream fin{fileName, std::ios::in | std::ios::binary};
+  REQUIRE(fin.is_open());
+  std::vector<char> data{std::istreambuf_iterator<char>{fin},
+                         std::istreambuf_iterator<char>{}};
+
+  logs::binary::Decoder decoder{data.data(), data.size()};
+  REQUIRE(decoder.isValid());
+
+  DecodedLog retval;
+  decoder.decode(
+      [&retval](const logs::FormatInfo &                          info,
+                std::chrono::time_point<std::chrono::system_clock> timePoint,
+                uint64_t                                           threadId,
+                boost::format                                      message) {
+        retval.records.push_back(DecodedRecord{info.severity,
+                                               std::string{info.functionName},
+                                               threadId,
+                                               message.str(),
+                                               timePoint});
+      });
+  retval.header  = decoder.getHeader();
+  retval.invalid = decoder.invalid();
+  return retval;
+}
+
+SCENARIO("writing and decoding of binary log", "[logs][binary]") {
+  GIVEN("binary logger") {
+    std::chrono::time_point<std::chrono::system_clock> begin =
+        std::chrono::system_clock::now();
+
+    WHEN("write records with arguments of every type") {
+      {
+        logs::BinaryLogger logger{TEST_LOG_FILE, 4096};
+        logs::BinaryLoggerFactory::set(&logger);
+
+        std::string      str = "string";
+        std::string_view view{"view"};
+        LOG_BINARY(logs::Severity::Info,
+                   "int %1% uint %2% double %3% float %4%",
+                   -42,
+                   uint64_t{18446744073709551615u},
+                   2.5,
+                   0.25f);
+        LOG_BINARY(logs::Severity::Warning,
+                   "bool %1% %2% char %3%",
+                   true,
+                   false,
+                   'x');
+        LOG_BINARY(logs::Severity::Error,
+                   "c-string %1% string %2% view %3% empty '%4%'",
+                   "literal",
+                   str,
+                   view,
+                   "");
+        LOG_BINARY(logs::Severity::Debug, "without arguments");
+
+        logs::BinaryLoggerFactory::set(nullptr);
+        CHECK(logger.dropped() == 0);
+      }
+
+      DecodedLog log = decodeFile(TEST_LOG_FILE);
+
+      THEN("all records are decoded with same arguments") {
+        CHECK(log.invalid == 0);
+        CHECK(log.header.dropped == 0);
+        REQUIRE(log.records.size() == 4);
+
+        CHECK(log.records[0].severity == logs::Severity::Info);
+        CHECK(log.records[0].message ==
+              "int -42 uint 18446744073709551615 double 2.5 float 0.25");
+
+        CHECK(log.records[1].severity == logs::Severity::Warning);
+        CHECK(log.records[1].message == "bool 1 0 char x");
+
+        CHECK(log.records[2].severity == logs::Severity::Error);
+        CHECK(log.records[2].message ==
+              "c-string literal string string view view empty ''");
+
+        CHECK(log.records[3].severity == logs::Severity::Debug);
+        CHECK(log.records[3].message == "without arguments");
+      }
+
+      THEN("metadata of records is saved") {
+        uint64_t threadId =
+            std::hash<std::thread::id>{}(std::this_thread::get_id());
+        for (const DecodedRecord &record : log.records) {
+          CHECK(record.threadId == threadId);
+          CHECK(record.functionName.empty() == false);
+          CHECK(record.timePoint >= begin -
+                                        std::chrono::milliseconds{100});
+          CHECK(record.timePoint <= std::chrono::system_clock::now());
+        }
+      }
+    }
+
+    WHEN("file is full") {
+      size_t dropped = 0;
+      {
+        // XXX the file has enough space for definitions of all formats, but
+        // not for all records
+        logs::BinaryLogger logger{TEST_LOG_FILE, 4096};
+        logs::BinaryLoggerFactory::set(&logger);
+
+        for (int i = 0; i < 1000; ++i) {
+          LOG_BINARY(logs::Severity::Info, "record %1%", i);
+        }
+
+        logs::BinaryLoggerFactory::set(nullptr);
+        dropped = logger.dropped();
+        CHECK(logger.size() <= 4096);
+      }
+
+      DecodedLog log = decodeFile(TEST_LOG_FILE);
+
+      THEN("records, which don't fit the file, are dropped") {
+        CHECK(dropped > 0);
+        CHECK(log.header.dropped == dropped);
+        CHECK(log.invalid == 0);
+        REQUIRE(log.records.size() + dropped == 1000);
+        for (size_t i = 0; i < log.records.size(); ++i) {
+          CHECK(log.records[i].message == "record " + std::to_string(i));
+        }
+      }
+    }
+
+    std::remove(TEST_LOG_FILE);
+  }
+
+  GIVEN("content, which is not binary log") {
+    std::string content = "not a binary log, but long enough for header";
+
+    logs::binary::Decoder decoder{content.data(), content.size()};
+
+    THEN("decoder doesn't read it") {
+      CHECK(decoder.isValid() == false);
+      CHECK(decoder.decode([](auto &&...) {}) == 0);
+    }
+  }
+}
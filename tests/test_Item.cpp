@@ -12,6 +12,7 @@
 #include <boost/geometry/strategies/transform/matrix_transformers.hpp>
 #include <boost/qvm/map_vec_mat.hpp>
 #include <svc/AbstractItem.hpp>
+#include <vector>
 
 using ItemPtr = svc::ItemPtr;
 
@@ -337,6 +338,8 @@ SCENARIO("test Item", "[Item]") {
         WHEN("try remove again") {
           THEN("produce exeption") {
             CHECK_THROWS(parentItem->removeChild(childItem.get()));
+            CHECK(parentItem->tryRemoveChild(childItem.get()) ==
+                  svc::Status::NotFound);
           }
         }
       }
@@ -355,6 +358,27 @@ SCENARIO("test Item", "[Item]") {
         }
       }
 
+      WHEN("read Scene rotation of the child, then move and rotate the "
+           "parent") {
+        float      defaultAngle = childItem->getSceneRotation();
+        float      angle        = ANGLE_GENERATOR(SECOND_LEVEL_GENERATOR);
+        svc::Point vec          = POINT_GENERATOR(SECOND_LEVEL_GENERATOR);
+
+        parentItem->moveOn(vec);
+        float movedAngle = childItem->getSceneRotation();
+
+        parentItem->rotate(angle);
+        float rotatedAngle = childItem->getSceneRotation();
+
+        THEN("moving must not change the Scene rotation of the child") {
+          CHECK_ANGLES_EQUAL(movedAngle, defaultAngle);
+        }
+
+        THEN("rotating must change the Scene rotation of the child") {
+          CHECK_ANGLES_EQUAL(rotatedAngle, defaultAngle + angle);
+        }
+      }
+
       WHEN("remove parent") {
         parentItem.reset();
 
@@ -381,6 +405,8 @@ SCENARIO("test Item", "[Item]") {
 
           svc::ItemPtr invalidItem;
           CHECK_THROWS(parentItem->removeChild(invalidItem.get()));
+          CHECK(parentItem->tryRemoveChild(invalidItem.get()) ==
+                svc::Status::InvalidArgument);
         }
       }
     }
@@ -421,6 +447,13 @@ SCENARIO("test Item", "[Item]") {
         THEN("parent has two children") {
           CHECK(parentItem->count() == 2);
         }
+        THEN("children are iterated in order of appending") {
+          svc::AbstractItem::ChildRange children =
+              parentItem->getChildrenRange();
+          REQUIRE(std::distance(children.begin(), children.end()) == 2);
+          CHECK(children.begin()->get() == childItem.get());
+          CHECK(std::next(children.begin())->get() == thirdItem.get());
+        }
       }
 
       WHEN("child change parent") {
@@ -452,6 +485,18 @@ SCENARIO("test Item", "[Item]") {
       WHEN("add parent for parent Item") {
         thirdItem->appendChild(parentItem);
 
+        THEN("subtree of top Item contains all descendants in pre-order") {
+          std::vector<svc::AbstractItem *> subtree;
+          for (const svc::ItemPtr &item : thirdItem->getSubtree()) {
+            subtree.emplace_back(item.get());
+          }
+
+          REQUIRE(subtree.size() == 2);
+          CHECK(subtree[0] == parentItem.get());
+          CHECK(subtree[1] == childItem.get());
+          CHECK(childItem->getSubtree().empty());
+        }
+
         THEN("parent now also has a parent") {
           CHECK(parentItem->getParent() == thirdItem.get());
         }
@@ -464,6 +509,16 @@ SCENARIO("test Item", "[Item]") {
           CHECK_POINTS_EQUAL(currentPos, childPos);
           CHECK_POINTS_EQUAL(currentScenePos, childScenePos);
         }
+
+        WHEN("move top Item after reading Scene position of the child") {
+          svc::Point scenePosBefore = childItem->getScenePos();
+          svc::Point diff           = POINT_GENERATOR(SECOND_LEVEL_GENERATOR);
+          thirdItem->setScenePos(defaultThirdScenePos + diff);
+
+          THEN("cached Scene position of the child must be updated") {
+            CHECK_POINTS_EQUAL(childItem->getScenePos(), scenePosBefore + diff);
+          }
+        }
       }
     }
   }
@@ -0,0 +1,520 @@
+// test_Logs.cpp
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch.hpp>
+
+//
+
+#include "async_logs.hpp"
+#include "logs.hpp"
+#include <condition_variable>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+/**\brief collects messages of all records
+ */
+class CaptureLogger final : public logs::BasicLogger {
+public:
+  void log(logs::Severity   severity,
+           std::string_view fileName,
+           int              lineNumber,
+           std::string_view functionName,
+           std::chrono::time_point<std::chrono::system_clock> timePoint,
+           std::thread::id                                    threadId,
+           boost::format message) noexcept override {
+    std::ignore = fileName;
+    std::ignore = lineNumber;
+    std::ignore = functionName;
+    std::ignore = timePoint;
+    std::ignore = threadId;
+
+    records.emplace_back(severity, message.str());
+  }
+
+  std::vector<std::pair<logs::Severity, std::string>> records;
+};
+
+/**\brief string buffer, which blocks writing until it will be opened. Used
+ * for stopping of background thread of AsyncLogger
+ */
+class GatedBuffer final : public std::stringbuf {
+public:
+  void open() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    opened_ = true;
+    condition_.notify_all();
+  }
+
+protected:
+  std::streamsize xsputn(const char *data, std::streamsize count) override {
+    {
+      std::unique_lock<std::mutex> lock{mutex_};
+      condition_.wait(lock, [this]() {
+        return opened_;
+      });
+    }
+    return std::stringbuf::xsputn(data, count);
+  }
+
+private:
+  std::mutex              mutex_;
+  std::condition_variable condition_;
+  bool                    opened_ = false;
+};
+
+/**\return numbers of records in order of writing. Every record must contain
+ * text `record <number>`
+ */
+static std::vector<int> recordNumbers(const std::string &output) {
+  std::vector<int>   retval;
+  std::istringstream lines{output};
+  for (std::string line; std::getline(lines, line);) {
+    size_t pos = line.find("record ");
+    REQUIRE(pos != line.npos);
+    retval.push_back(std::stoi(line.substr(pos + 7)));
+  }
+  return retval;
+}
+
+/**\brief set the logger for the scope
+ */
+class LoggerGuard final {
+public:
+  explicit LoggerGuard(logs::BasicLogger &logger) noexcept {
+    logs::LoggerFactory::set(&logger);
+  }
+
+  ~LoggerGuard() noexcept {
+    logs::LoggerFactory::set(nullptr);
+  }
+};
+
+// XXX must be first scenario, because the registry reads environment only once
+SCENARIO("thresholds from environment", "[logs]") {
+  GIVEN("LOG_LEVELS set before first use of the registry") {
+    setenv("LOG_LEVELS", "environment=error", 1);
+
+    logs::CategoryRegistry &registry = logs::CategoryRegistry::get();
+
+    THEN("the category has threshold from the environment") {
+      logs::Category &category = registry.getCategory("environment");
+      CHECK(category.isEnabled(logs::Severity::Error));
+      CHECK(category.isEnabled(logs::Severity::Warning) == false);
+    }
+  }
+}
+
+SCENARIO("parsing of LOG_LEVELS specification", "[logs]") {
+  logs::CategoryRegistry &registry = logs::CategoryRegistry::get();
+  registry.setThreshold(logs::Severity::Debug);
+
+  GIVEN("named levels") {
+    REQUIRE(registry.configure("alpha=error,beta=info"));
+
+    THEN("every category gets its own threshold") {
+      logs::Category &alpha = registry.getCategory("alpha");
+      CHECK(alpha.isEnabled(logs::Severity::Error));
+      CHECK(alpha.isEnabled(logs::Severity::Warning) == false);
+
+      logs::Category &beta = registry.getCategory("beta");
+      CHECK(beta.isEnabled(logs::Severity::Info));
+      CHECK(beta.isEnabled(logs::Severity::Debug) == false);
+    }
+  }
+
+  GIVEN("bare level") {
+    logs::Category &existing = registry.getCategory("existing");
+    REQUIRE(registry.configure("warning"));
+
+    THEN("existing categories are changed") {
+      CHECK(existing.isEnabled(logs::Severity::Warning));
+      CHECK(existing.isEnabled(logs::Severity::Info) == false);
+    }
+
+    THEN("categories created later get the level") {
+      logs::Category &later = registry.getCategory("later");
+      CHECK(later.isEnabled(logs::Severity::Warning));
+      CHECK(later.isEnabled(logs::Severity::Info) == false);
+    }
+  }
+
+  GIVEN("bare level and named level") {
+    REQUIRE(registry.configure("error,gamma=debug"));
+
+    THEN("named level overrides bare level") {
+      CHECK(registry.getCategory("gamma").isEnabled(logs::Severity::Debug));
+      CHECK(registry.getCategory("delta").isEnabled(logs::Severity::Warning) ==
+            false);
+    }
+  }
+
+  GIVEN("specification with invalid item") {
+    CHECK(registry.configure("first=error,second=verbose,third=error") ==
+          false);
+
+    THEN("items before the invalid one are applied") {
+      CHECK(registry.getCategory("first").isEnabled(logs::Severity::Warning) ==
+            false);
+      CHECK(registry.getCategory("third").isEnabled(logs::Severity::Warning));
+    }
+  }
+
+  GIVEN("invalid bare level") {
+    CHECK(registry.configure("verbose") == false);
+
+    THEN("thresholds are not changed") {
+      CHECK(registry.getCategory("bare").isEnabled(logs::Severity::Debug));
+    }
+  }
+
+  GIVEN("empty items") {
+    THEN("specification is invalid") {
+      CHECK(registry.configure("alpha=") == false);
+      CHECK(registry.configure("alpha=info,,beta=info") == false);
+    }
+  }
+
+  registry.setThreshold(logs::Severity::Debug);
+}
+
+SCENARIO("changing of threshold at runtime", "[logs]") {
+  CaptureLogger logger;
+  LoggerGuard   guard{logger};
+
+  logs::CategoryRegistry &registry = logs::CategoryRegistry::get();
+
+  auto write = [](int value) {
+    LOG_INFO_C("runtime", "value %1%", value);
+  };
+
+  GIVEN("category with disabled severity") {
+    registry.setThreshold("runtime", logs::Severity::Error);
+    write(1);
+
+    THEN("record is not written") {
+      CHECK(logger.records.empty());
+    }
+
+    WHEN("decrease threshold") {
+      registry.setThreshold("runtime", logs::Severity::Info);
+      write(2);
+
+      THEN("following records are written") {
+        REQUIRE(logger.records.size() == 1);
+        CHECK(logger.records[0].first == logs::Severity::Info);
+        CHECK(logger.records[0].second == "value 2");
+      }
+
+      WHEN("increase threshold again") {
+        registry.setThreshold("runtime", logs::Severity::Warning);
+        write(3);
+
+        THEN("records are not written anymore") {
+          CHECK(logger.records.size() == 1);
+        }
+      }
+    }
+  }
+}
+
+SCENARIO("arguments of disabled records", "[logs]") {
+  CaptureLogger logger;
+  LoggerGuard   guard{logger};
+
+  logs::CategoryRegistry &registry = logs::CategoryRegistry::get();
+
+  int  evaluated = 0;
+  auto argument  = [&evaluated]() {
+    return ++evaluated;
+  };
+
+  auto write = [&argument]() {
+    LOG_DEBUG_C("lazy", "argument %1%", argument());
+  };
+
+  GIVEN("disabled severity") {
+    registry.setThreshold("lazy", logs::Severity::Warning);
+    write();
+
+    THEN("arguments are not evaluated") {
+      CHECK(evaluated == 0);
+      CHECK(logger.records.empty());
+    }
+  }
+
+  GIVEN("enabled severity") {
+    registry.setThreshold("lazy", logs::Severity::Debug);
+    write();
+
+    THEN("arguments are evaluated once") {
+      CHECK(evaluated == 1);
+      REQUIRE(logger.records.size() == 1);
+      CHECK(logger.records[0].second == "argument 1");
+    }
+  }
+}
+
+SCENARIO("writing records by AsyncLogger", "[logs][async]") {
+  logs::CategoryRegistry::get().setThreshold("async", logs::Severity::Debug);
+
+  GIVEN("logger writing to string stream") {
+    std::ostringstream out;
+
+    WHEN("write records by one thread") {
+      {
+        logs::AsyncLogger logger{out, 16, logs::OverflowPolicy::Block, 4};
+        LoggerGuard       guard{logger};
+
+        for (int i = 0; i < 100; ++i) {
+          LOG_INFO_C("async", "record %1%", i);
+        }
+        logger.flush();
+
+        THEN("all records are written after flush in same order") {
+          std::vector<int> numbers = recordNumbers(out.str());
+          REQUIRE(numbers.size() == 100);
+          for (int i = 0; i < 100; ++i) {
+            CHECK(numbers[i] == i);
+          }
+          CHECK(logger.dropped() == 0);
+        }
+      }
+    }
+
+    WHEN("destroy logger without flush") {
+      {
+        logs::AsyncLogger logger{out, 128};
+        LoggerGuard       guard{logger};
+
+        for (int i = 0; i < 100; ++i) {
+          LOG_INFO_C("async", "record %1%", i);
+        }
+      }
+
+      THEN("destructor writes all records from the buffer") {
+        CHECK(recordNumbers(out.str()).size() == 100);
+      }
+    }
+
+    WHEN("write records by several threads") {
+      logs::AsyncLogger logger{out, 8, logs::OverflowPolicy::Block};
+      {
+        LoggerGuard              guard{logger};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+          threads.emplace_back([t]() {
+            for (int i = 0; i < 100; ++i) {
+              LOG_INFO_C("async", "record %1%", t * 1000 + i);
+            }
+          });
+        }
+        for (std::thread &thread : threads) {
+          thread.join();
+        }
+      }
+      logger.flush();
+
+      THEN("records of every thread are written in order") {
+        std::vector<int> numbers = recordNumbers(out.str());
+        REQUIRE(numbers.size() == 400);
+
+        std::vector<int> last(4, -1);
+        for (int number : numbers) {
+          int &previous = last[number / 1000];
+          CHECK(previous < number % 1000);
+          previous = number % 1000;
+        }
+      }
+    }
+  }
+
+  GIVEN("logger with blocked output") {
+    GatedBuffer  buffer;
+    std::ostream out{&buffer};
+
+    WHEN("overflow policy is Drop") {
+      {
+        logs::AsyncLogger logger{out, 2, logs::OverflowPolicy::Drop, 1};
+        LoggerGuard       guard{logger};
+
+        for (int i = 0; i < 10; ++i) {
+          LOG_INFO_C("async", "record %1%", i);
+        }
+
+        THEN("records, which don't fit the buffer, are dropped") {
+          // XXX one record can be written by background thread, and two
+          // records are in the buffer
+          CHECK(logger.dropped() >= 7);
+
+          buffer.open();
+          logger.flush();
+
+          std::vector<int> numbers = recordNumbers(buffer.str());
+          CHECK(numbers.size() + logger.dropped() == 10);
+          CHECK(std::is_sorted(numbers.begin(), numbers.end()));
+        }
+
+        buffer.open();
+      }
+    }
+
+    WHEN("write Error record while the buffer is full") {
+      logs::AsyncLogger logger{out, 2, logs::OverflowPolicy::Drop, 1};
+      LoggerGuard       guard{logger};
+
+      for (int i = 0; i < 10; ++i) {
+        LOG_INFO_C("async", "record %1%", i);
+      }
+      size_t dropped = logger.dropped();
+
+      std::thread producer{[]() {
+        LOG_ERROR_C("async", "record %1%", 10);
+      }};
+
+      THEN("the record is not dropped and written after previous records") {
+        buffer.open();
+        producer.join();
+
+        // XXX the record is written by calling thread, so flush is not needed
+        std::vector<int> numbers = recordNumbers(buffer.str());
+        REQUIRE(numbers.empty() == false);
+        CHECK(numbers.back() == 10);
+        CHECK(numbers.size() + dropped == 11);
+        CHECK(logger.dropped() == dropped);
+      }
+
+      buffer.open();
+      if (producer.joinable()) {
+        producer.join();
+      }
+    }
+
+    WHEN("overflow policy is Block") {
+      logs::AsyncLogger logger{out, 2, logs::OverflowPolicy::Block, 1};
+      LoggerGuard       guard{logger};
+
+      std::atomic<bool> finished{false};
+      std::thread       producer{[&finished]() {
+        for (int i = 0; i < 10; ++i) {
+          LOG_INFO_C("async", "record %1%", i);
+        }
+        finished.store(true);
+      }};
+
+      std::this_thread::sleep_for(std::chrono::milliseconds{50});
+
+      THEN("calling thread waits until records are written") {
+        CHECK(finished.load() == false);
+
+        buffer.open();
+        producer.join();
+        logger.flush();
+
+        CHECK(finished.load());
+        CHECK(logger.dropped() == 0);
+        CHECK(recordNumbers(buffer.str()) ==
+              std::vector<int>{0, 1, 2, 3, 4, 5, 6, 7, 8, 9});
+      }
+
+      buffer.open();
+      if (producer.joinable()) {
+        producer.join();
+      }
+    }
+  }
+}
+
+/**\brief argument, which remembers thread of its printing
+ */
+struct ThreadMarker {
+  std::thread::id *thread;
+};
+
+static std::ostream &operator<<(std::ostream &stream,
+                                const ThreadMarker &marker) {
+  *marker.thread = std::this_thread::get_id();
+  return stream << "marker";
+}
+
+SCENARIO("deferred formatting of messages", "[logs][async]") {
+  logs::CategoryRegistry &registry = logs::CategoryRegistry::get();
+  registry.setThreshold("deferred", logs::Severity::Debug);
+
+  std::thread::id formatThread;
+
+  GIVEN("AsyncLogger") {
+    std::ostringstream out;
+    logs::AsyncLogger  logger{out};
+    LoggerGuard        guard{logger};
+
+    WHEN("write record by LOG_ASYNC_C") {
+      LOG_ASYNC_C(logs::Severity::Info,
+                  "deferred",
+                  "record %1% %2% %3%",
+                  1,
+                  std::string{"of"},
+                  ThreadMarker{&formatThread});
+      logger.flush();
+
+      THEN("message is formatted by background thread") {
+        CHECK(out.str().find("record 1 of marker") != std::string::npos);
+        CHECK(formatThread != std::thread::id{});
+        CHECK(formatThread != std::this_thread::get_id());
+      }
+    }
+
+    WHEN("write record with big arguments") {
+      std::string big(200, 'x');
+      LOG_ASYNC_C(logs::Severity::Info,
+                  "deferred",
+                  "record %1% %2% %3% %4%",
+                  2,
+                  big,
+                  big,
+                  big);
+      logger.flush();
+
+      THEN("arguments are copied to the record") {
+        CHECK(out.str().find("record 2 " + big) != std::string::npos);
+      }
+    }
+  }
+
+  GIVEN("logger without deferred formatting") {
+    CaptureLogger logger;
+    LoggerGuard   guard{logger};
+
+    LOG_ASYNC_C(logs::Severity::Info,
+                "deferred",
+                "record %1% %2%",
+                3,
+                ThreadMarker{&formatThread});
+
+    THEN("message is formatted by calling thread") {
+      REQUIRE(logger.records.size() == 1);
+      CHECK(logger.records[0].second == "record 3 marker");
+      CHECK(formatThread == std::this_thread::get_id());
+    }
+  }
+
+  GIVEN("disabled severity") {
+    registry.setThreshold("deferred", logs::Severity::Error);
+
+    CaptureLogger logger;
+    LoggerGuard   guard{logger};
+
+    LOG_ASYNC_C(logs::Severity::Info,
+                "deferred",
+                "record %1%",
+                ThreadMarker{&formatThread});
+
+    THEN("nothing is written") {
+      CHECK(logger.records.empty());
+      CHECK(formatThread == std::thread::id{});
+    }
+  }
+}
@@ -5,11 +5,14 @@
 
 //
 
+#include "svc/BatchTransform.hpp"
 #include "svc/base_geometry_types.hpp"
 #include "test_auxilary.hpp"
 #include <boost/geometry/algorithms/is_valid.hpp>
 #include <boost/geometry/strategies/strategies.hpp>
+#include <boost/qvm/map_vec_mat.hpp>
 #include <boost/qvm/swizzle.hpp>
+#include <algorithm>
 
 SCENARIO("test Rect", "[Rect]") {
   GIVEN("simple Rect without rotation") {
@@ -59,6 +62,29 @@ SCENARIO("test Rect", "[Rect]") {
       }
     }
 
+    WHEN("set scaled and rotated transformation") {
+      float angle = ANGLE_GENERATOR(SECOND_LEVEL_GENERATOR);
+      rect.setTransform(svc::Affine::translation(minCorner) *
+                        svc::Affine::rotation(angle) *
+                        svc::Affine::scale(2, 3));
+
+      THEN("decomposition must contain the rotation and the scale") {
+        const svc::Decomposition &decomposition = rect.getDecomposition();
+        CHECK_ANGLES_EQUAL(decomposition.angle, angle);
+        CHECK(Approx{decomposition.sinAngle}.margin(0.001) == std::sin(angle));
+        CHECK(Approx{decomposition.cosAngle}.margin(0.001) == std::cos(angle));
+        CHECK(Approx{decomposition.scaleFactors.first} == 2);
+        CHECK(Approx{decomposition.scaleFactors.second} == 3);
+      }
+
+      THEN("rotating must keep the decomposition same as computed from the "
+           "transformation") {
+        rect.rotate(angle, svc::Point{10, 0});
+        CHECK_ANGLES_EQUAL(rect.getRotation(),
+                           svc::getRotation(rect.getTransform()));
+      }
+    }
+
     WHEN("set new minCorner") {
       svc::Point newMinCorner = POINT_GENERATOR(SECOND_LEVEL_GENERATOR);
 
@@ -167,6 +193,158 @@ SCENARIO("test Rect", "[Rect]") {
 
         CHECK_POINTS_EQUAL(ring[2], maxCorner);
       }
+
+      AND_WHEN("write the Rect to existing Ring") {
+        svc::Ring reused{{1, 1}, {2, 2}, {3, 3}, {4, 4}, {5, 5}};
+        rect.toRing(reused);
+
+        THEN("the Ring contains same points as converted Ring") {
+          REQUIRE(reused.size() == ring.size());
+          for (size_t i = 0; i < ring.size(); ++i) {
+            CHECK_POINTS_EQUAL(reused[i], ring[i]);
+          }
+        }
+      }
+    }
+  }
+}
+
+SCENARIO("test Affine", "[Rect]") {
+  GIVEN("transformation with translation, rotation and scale") {
+    svc::Point pos    = POINT_GENERATOR(FIRST_LEVEL_GENERATOR);
+    float      angle  = ANGLE_GENERATOR(FIRST_LEVEL_GENERATOR);
+    svc::Point anchor = POINT_GENERATOR(1);
+
+    svc::Affine aff = svc::Affine::translation(pos) *
+                      svc::Affine::rotation(angle, anchor) *
+                      svc::Affine::scale(2, 3);
+    svc::Matrix mat = boost::qvm::translation_mat(pos) *
+                      boost::qvm::translation_mat(anchor) *
+                      boost::qvm::rotz_mat<3>(angle) *
+                      boost::qvm::translation_mat(-anchor) *
+                      boost::qvm::diag_mat(boost::qvm::XY1(svc::Point{2, 3}));
+
+    svc::Point point = POINT_GENERATOR(1);
+
+    THEN("composition must be same as multiplication of matrices") {
+      svc::Point expected = boost::qvm::XY(mat * boost::qvm::XY1(point));
+      CHECK_POINTS_EQUAL(svc::transformPoint(aff, point), expected);
+    }
+
+    THEN("conversion to Matrix and back must not change the transformation") {
+      svc::Affine converted = svc::toAffine(svc::toMatrix(aff));
+      CHECK_POINTS_EQUAL(svc::transformPoint(converted, point),
+                         svc::transformPoint(aff, point));
+    }
+
+    THEN("inverse transformation must return the point back") {
+      CHECK_POINTS_EQUAL(
+          svc::transformPoint(svc::inverse(aff),
+                              svc::transformPoint(aff, point)),
+          point);
+    }
+
+    THEN("rotation and scale factors must be same as for Matrix") {
+      CHECK_ANGLES_EQUAL(svc::getRotation(aff), svc::getRotation(mat));
+      CHECK(Approx{svc::getScaleFactors(aff).first}.epsilon(0.01) ==
+            svc::getScaleFactors(mat).first);
+      CHECK(Approx{svc::getScaleFactors(aff).second}.epsilon(0.01) ==
+            svc::getScaleFactors(mat).second);
+    }
+
+    WHEN("transform Box") {
+      svc::Box box{point, {point.x() + 10, point.y() + 20}};
+      svc::Box transformed = svc::transformBox(aff, box);
+
+      THEN("all corners of transformed Box must be inside the result") {
+        svc::Ring ring = svc::Rect{box};
+        for (const svc::Point &corner : ring) {
+          svc::Point transformedCorner = svc::transformPoint(aff, corner);
+          CHECK(transformedCorner.x() >= transformed.min_corner().x() - 0.01);
+          CHECK(transformedCorner.y() >= transformed.min_corner().y() - 0.01);
+          CHECK(transformedCorner.x() <= transformed.max_corner().x() + 0.01);
+          CHECK(transformedCorner.y() <= transformed.max_corner().y() + 0.01);
+        }
+      }
+    }
+  }
+}
+
+SCENARIO("test batch transformations", "[Rect]") {
+  svc::BatchKernel kernel = GENERATE(svc::BatchKernel::Scalar,
+                                     svc::BatchKernel::Sse2,
+                                     svc::BatchKernel::Avx2);
+  svc::BatchKernel defaultKernel = svc::getBatchKernel();
+  if (svc::setBatchKernel(kernel) == false) {
+    WARN("kernel " << svc::toString(kernel) << " is not supported");
+    return;
+  }
+
+  GIVEN("arrays of points, boxes and transformations with not vectorized "
+        "tails") {
+    // XXX count is not multiple of 2 and 4, so tails are checked too
+    const size_t count = 7;
+
+    svc::Point offset = POINT_GENERATOR(1);
+    float      angle  = ANGLE_GENERATOR(1);
+
+    std::vector<svc::Point>  points;
+    std::vector<svc::Box>    boxes;
+    std::vector<svc::Affine> transforms;
+    for (size_t i = 0; i < count; ++i) {
+      float      step = i + 1;
+      svc::Point point{offset.x() + step * 37, offset.y() - step * 11};
+
+      points.emplace_back(point);
+      boxes.emplace_back(point,
+                         svc::Point{point.x() + step * 10, point.y() + 5});
+      transforms.emplace_back(svc::Affine::translation(point) *
+                              svc::Affine::rotation(angle * step) *
+                              svc::Affine::scale(step, 2));
+    }
+
+    WHEN("transform points") {
+      std::vector<svc::Point> out(count);
+      svc::transformPoints(transforms[0], points.data(), out.data(), count);
+
+      THEN("every point must be transformed same as by single transforming") {
+        for (size_t i = 0; i < count; ++i) {
+          CHECK_POINTS_EQUAL(out[i],
+                             svc::transformPoint(transforms[0], points[i]));
+        }
+      }
+    }
+
+    WHEN("transform boxes") {
+      std::vector<svc::Box> out(count);
+      svc::transformBoxes(transforms.data(), boxes.data(), out.data(), count);
+
+      THEN("every box must be transformed same as by single transforming") {
+        for (size_t i = 0; i < count; ++i) {
+          svc::Box expected = svc::transformBox(transforms[i], boxes[i]);
+          CHECK_POINTS_EQUAL(out[i].min_corner(), expected.min_corner());
+          CHECK_POINTS_EQUAL(out[i].max_corner(), expected.max_corner());
+        }
+      }
+    }
+
+    WHEN("compose transformations in place") {
+      std::vector<svc::Affine> out = transforms;
+      std::reverse(out.begin(), out.end());
+      svc::composeTransforms(transforms.data(), out.data(), out.data(), count);
+
+      THEN("every pair must be composed same as by multiplication") {
+        for (size_t i = 0; i < count; ++i) {
+          svc::Affine expected = transforms[i] * transforms[count - 1 - i];
+          for (int r = 0; r < 2; ++r) {
+            for (int c = 0; c < 3; ++c) {
+              CHECK(Approx{out[i].a[r][c]}.margin(0.01) == expected.a[r][c]);
+            }
+          }
+        }
+      }
     }
   }
+
+  svc::setBatchKernel(defaultKernel);
 }
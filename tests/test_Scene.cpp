@@ -11,6 +11,11 @@
 #include <boost/geometry/algorithms/area.hpp>
 #include <boost/geometry/strategies/strategies.hpp>
 #include <boost/qvm/map_vec_mat.hpp>
+#include <atomic>
+#include <memory_resource>
+#include <mutex>
+#include <sstream>
+#include <thread>
 
 class BasicItem final : public svc::AbstractItem {
 public:
@@ -24,6 +29,42 @@ public:
   using AbstractItem::setMatrix;
 };
 
+/**\brief Item with changeable bounding box
+ */
+class ResizableItem final : public svc::AbstractItem {
+public:
+  svc::Box box{{-5, -5}, {5, 5}};
+
+  svc::Box getBoundingBox() const noexcept override {
+    return box;
+  }
+
+  void accept([[maybe_unused]] svc::AbstractVisitor *visitor) override {
+  }
+};
+
+/**\brief counts allocations passed to upstream resource
+ */
+class CountingResource final : public std::pmr::memory_resource {
+public:
+  size_t allocations = 0;
+
+private:
+  void *do_allocate(size_t bytes, size_t alignment) override {
+    ++allocations;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+
+  void do_deallocate(void *p, size_t bytes, size_t alignment) override {
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+  }
+
+  bool do_is_equal(
+      const std::pmr::memory_resource &other) const noexcept override {
+    return this == &other;
+  }
+};
+
 SCENARIO("test Scene", "[Scene]") {
   GIVEN("empty Scene") {
     svc::Scene scene;
@@ -44,6 +85,18 @@ SCENARIO("test Scene", "[Scene]") {
         svc::ItemPtr itemWithoutScene = std::make_shared<BasicItem>();
         CHECK_THROWS(scene.removeItem(itemWithoutScene.get()));
       }
+
+      THEN("non-throwing variants return status") {
+        CHECK(scene.tryRemoveItem(nullptr) == svc::Status::InvalidArgument);
+        CHECK(scene.tryUpdateItemPosition(nullptr) ==
+              svc::Status::InvalidArgument);
+
+        svc::ItemPtr itemWithoutScene = std::make_shared<BasicItem>();
+        CHECK(scene.tryRemoveItem(itemWithoutScene.get()) ==
+              svc::Status::NotFound);
+        CHECK(scene.tryUpdateItemPosition(itemWithoutScene.get()) ==
+              svc::Status::NotFound);
+      }
     }
 
     WHEN("try add invalid Item") {
@@ -106,10 +159,41 @@ SCENARIO("test Scene", "[Scene]") {
       WHEN("try remove again") {
         THEN("produce error") {
           CHECK_THROWS(scene->removeItem(item.get()));
+          CHECK(scene->tryRemoveItem(item.get()) == svc::Status::NotFound);
         }
       }
     }
 
+    WHEN("remove Item by non-throwing variant") {
+      CHECK(scene->tryUpdateItemPosition(item.get()) == svc::Status::Ok);
+      CHECK(scene->tryRemoveItem(item.get()) == svc::Status::Ok);
+
+      THEN("the Item is removed") {
+        CHECK(scene->empty());
+        CHECK(item->getScene() == nullptr);
+      }
+    }
+
+    WHEN("remove Item with child by non-throwing variant") {
+      std::weak_ptr<svc::AbstractItem> child;
+      {
+        svc::ItemPtr childItem = std::make_shared<BasicItem>();
+        item->appendChild(childItem);
+        child = childItem;
+      }
+      REQUIRE(scene->count() == 2);
+
+      CHECK(scene->tryRemoveItem(item.get()) == svc::Status::Ok);
+
+      THEN("Scene doesn't hold the Item and its child") {
+        CHECK(scene->empty());
+        CHECK(item.use_count() == 1);
+
+        item.reset();
+        CHECK(child.expired());
+      }
+    }
+
     WHEN("clear Scene") {
       scene->clear();
 
@@ -312,6 +396,120 @@ SCENARIO("test Scene", "[Scene]") {
       CHECK(fourd->getScene() == scene.get());
     }
 
+    WHEN("move root item") {
+      first->setScenePos(svc::Point{100, 100});
+
+      THEN("all Items must be reindexed") {
+        CHECK(scene->count() == 4);
+        CHECK(scene->query(svc::Point{100, 100}).size() == 4);
+        CHECK(scene->query(svc::Point{0, 0}).empty());
+      }
+    }
+
+    WHEN("move nested item, when Scene contains a lot of other Items") {
+      for (int i = 0; i < 20; ++i) {
+        svc::ItemPtr other = std::make_shared<BasicItem>();
+        other->setScenePos(svc::Point{-100, -100});
+        scene->appendItem(other);
+      }
+
+      third->setScenePos(svc::Point{50, 50});
+
+      THEN("only the Item and its children must be reindexed") {
+        CHECK(scene->count() == 24);
+        CHECK(scene->query(svc::Point{50, 50}).size() == 2);
+        CHECK(scene->query(svc::Point{0, 0}).size() == 2);
+        CHECK(scene->query(svc::Point{-100, -100}).size() == 20);
+      }
+    }
+
+    WHEN("rotate nested item and after move root item") {
+      third->setPos(svc::Point{10, 0});
+      second->rotate(M_PI / 2);
+      first->moveOn(svc::Point{100, 100});
+
+      THEN("children of rotated Item must be reindexed by new positions") {
+        svc::ItemList found = scene->query(third->getScenePos());
+        CHECK(std::count(found.begin(), found.end(), third) == 1);
+        CHECK(std::count(found.begin(), found.end(), fourd) == 1);
+      }
+    }
+
+    WHEN("append root item to other Item of the Scene and move new parent") {
+      svc::ItemPtr other = std::make_shared<BasicItem>();
+      other->setScenePos(svc::Point{200, 0});
+      scene->appendItem(other);
+
+      other->appendChild(first);
+      other->setScenePos(svc::Point{300, 0});
+
+      THEN("all children of new parent must be reindexed") {
+        CHECK(scene->count() == 5);
+        CHECK(scene->query(svc::Point{300, 0}).size() == 1);
+        CHECK(scene->query(svc::Point{100, 0}).size() == 4);
+        CHECK(scene->query(svc::Point{0, 0}).empty());
+      }
+    }
+
+    WHEN("append new Items to nested Item, when Scene contains other root "
+         "Item, and move root item") {
+      svc::ItemPtr other = std::make_shared<BasicItem>();
+      other->setScenePos(svc::Point{-100, -100});
+      scene->appendItem(other);
+
+      svc::ItemPtr extra       = std::make_shared<BasicItem>();
+      svc::ItemPtr extraNested = std::make_shared<BasicItem>();
+      second->appendChild(extra);
+      extra->appendChild(extraNested);
+
+      first->setScenePos(svc::Point{100, 100});
+
+      THEN("new Items are moved with the root item") {
+        CHECK(scene->count() == 7);
+        CHECK(scene->query(svc::Point{100, 100}).size() == 6);
+        CHECK(scene->query(svc::Point{-100, -100}).size() == 1);
+        CHECK(scene->query(svc::Point{0, 0}).empty());
+      }
+
+      AND_WHEN("append root item to the other Item and move the other Item") {
+        other->appendChild(first);
+        other->setScenePos(svc::Point{0, -100});
+
+        THEN("all Items are moved with new parent") {
+          CHECK(scene->count() == 7);
+          CHECK(scene->query(svc::Point{0, -100}).size() == 1);
+          CHECK(scene->query(svc::Point{200, 100}).size() == 6);
+          CHECK(scene->query(svc::Point{100, 100}).empty());
+        }
+
+        AND_WHEN("move nested Item to the other Item and move root item") {
+          other->appendChild(extra);
+          first->setScenePos(svc::Point{300, 300});
+
+          THEN("moved Item doesn't follow old parent") {
+            CHECK(scene->count() == 7);
+            CHECK(scene->query(svc::Point{300, 300}).size() == 4);
+            CHECK(scene->query(svc::Point{200, 100}).size() == 2);
+          }
+        }
+      }
+    }
+
+    WHEN("bounding box of nested Item is changed and root item is moved") {
+      std::shared_ptr<ResizableItem> resizable =
+          std::make_shared<ResizableItem>();
+      svc::ItemPtr item = resizable;
+      third->appendChild(item);
+
+      resizable->box = svc::Box{{20, 20}, {30, 30}};
+      first->setScenePos(svc::Point{100, 100});
+
+      THEN("the Item is reindexed by new bounding box") {
+        CHECK(scene->query(svc::Point{125, 125}).size() == 1);
+        CHECK(scene->query(svc::Point{100, 100}).size() == 4);
+      }
+    }
+
     WHEN("remove root item") {
       scene->removeItem(first.get());
 
@@ -328,6 +526,30 @@ SCENARIO("test Scene", "[Scene]") {
     }
   }
 
+  GIVEN("Scene with deep chain of Items appended one by one") {
+    std::shared_ptr<svc::Scene> scene = std::make_shared<svc::Scene>();
+
+    svc::ItemPtr root = std::make_shared<BasicItem>();
+    scene->appendItem(root);
+
+    svc::ItemPtr last = root;
+    for (int i = 0; i < 200; ++i) {
+      svc::ItemPtr item = std::make_shared<BasicItem>();
+      last->appendChild(item);
+      last = item;
+    }
+
+    WHEN("move root Item") {
+      root->setScenePos(svc::Point{100, 100});
+
+      THEN("all Items of the chain are moved") {
+        CHECK(scene->count() == 201);
+        CHECK(scene->query(svc::Point{100, 100}).size() == 201);
+        CHECK(scene->query(svc::Point{0, 0}).empty());
+      }
+    }
+  }
+
   GIVEN("two Scene and Item-s for changing ownership") {
     std::shared_ptr<svc::Scene> scene1 = std::make_shared<svc::Scene>();
     std::shared_ptr<svc::Scene> scene2 = std::make_shared<svc::Scene>();
@@ -543,6 +765,38 @@ SCENARIO("test Scene", "[Scene]") {
         }
       }
     }
+
+    WHEN("query Items to buffer") {
+      svc::ItemBuffer buffer;
+      scene->query(svc::Box{{0, 0}, {60, 60}}, buffer);
+
+      THEN("buffer must contains both Items") {
+        REQUIRE(buffer.size() == 2);
+        CHECK(buffer.front() != buffer.back());
+      }
+
+      AND_WHEN("reuse the buffer for next query") {
+        const svc::AbstractItem *const *data = buffer.data();
+        scene->query(firstInitialPoint, buffer);
+
+        THEN("buffer contains only last result and is not reallocated") {
+          REQUIRE(buffer.size() == 1);
+          CHECK(buffer.front() == firstItem.get());
+          CHECK(buffer.data() == data);
+        }
+      }
+
+      AND_WHEN("query by polygon to same buffer") {
+        svc::Ring ring{{0, 0}, {0, 30}, {30, 30}, {30, 0}, {0, 0}};
+        scene->query(ring, buffer);
+
+        THEN("buffer contains same Items as list") {
+          svc::ItemList list = scene->query(ring);
+          REQUIRE(buffer.size() == list.size());
+          CHECK(buffer.front() == list.front().get());
+        }
+      }
+    }
   }
 
   GIVEN("Scene with one Item") {
@@ -651,4 +905,726 @@ SCENARIO("test Scene", "[Scene]") {
       }
     }
   }
+
+  GIVEN("Scene with Items with different flags in same place") {
+    enum Flags : svc::ItemFlags { Selectable = 1, Visible = 2 };
+
+    std::shared_ptr<svc::Scene> scene = std::make_shared<svc::Scene>();
+
+    svc::Point initialPoint = POINT_GENERATOR(FIRST_LEVEL_GENERATOR);
+
+    svc::ItemPtr selectable = std::make_shared<BasicItem>();
+    svc::ItemPtr visible    = std::make_shared<BasicItem>();
+    svc::ItemPtr both       = std::make_shared<BasicItem>();
+    selectable->setScenePos(initialPoint);
+    visible->setScenePos(initialPoint);
+    both->setScenePos(initialPoint);
+
+    scene->appendItem(selectable);
+    scene->appendItem(visible);
+    scene->appendItem(both);
+
+    scene->setItemFlags(selectable.get(), Selectable);
+    scene->setItemFlags(visible.get(), Visible);
+    scene->setItemFlags(both.get(), Selectable | Visible);
+
+    THEN("flags can be got back") {
+      CHECK(scene->getItemFlags(selectable.get()) == Selectable);
+      CHECK(scene->getItemFlags(both.get()) == (Selectable | Visible));
+    }
+
+    THEN("query without filter returns all Items") {
+      CHECK(scene->query(initialPoint).size() == 3);
+    }
+
+    THEN("query with required flags returns only Items with the flags") {
+      svc::ItemList list = scene->query(initialPoint, {Selectable | Visible});
+
+      REQUIRE(list.size() == 1);
+      CHECK(list.front() == both);
+    }
+
+    THEN("query with forbidden flags doesn't return Items with the flags") {
+      svc::Box      box{initialPoint - svc::Point{10, 10},
+                   initialPoint + svc::Point{10, 10}};
+      svc::ItemList list = scene->query(
+          box, svc::Scene::SpatialIndex::Intersects, {Selectable, Visible});
+
+      REQUIRE(list.size() == 1);
+      CHECK(list.front() == selectable);
+    }
+
+    WHEN("move Item with flags") {
+      svc::Point newPos = initialPoint + svc::Point{100, 100};
+      both->setScenePos(newPos);
+
+      THEN("the Item saves its flags") {
+        CHECK(scene->getItemFlags(both.get()) == (Selectable | Visible));
+
+        svc::ItemList list = scene->query(newPos, {Selectable});
+        REQUIRE(list.size() == 1);
+        CHECK(list.front() == both);
+      }
+    }
+
+    WHEN("change flags of the Item") {
+      scene->setItemFlags(selectable.get(), Visible);
+
+      THEN("queries use new flags and the Item is indexed once") {
+        CHECK(scene->query(initialPoint).size() == 3);
+        CHECK(scene->query(initialPoint, {Selectable}).size() == 1);
+        CHECK(scene->query(initialPoint, {Visible}).size() == 3);
+      }
+    }
+
+    WHEN("remove Item") {
+      scene->removeItem(visible.get());
+
+      THEN("flags of the Item are not available") {
+        CHECK_THROWS(scene->getItemFlags(visible.get()));
+        CHECK_THROWS(scene->setItemFlags(visible.get(), Visible));
+      }
+    }
+  }
+
+  GIVEN("Scene with two parents and child with flags") {
+    enum Flags : svc::ItemFlags { Selectable = 1, Visible = 2 };
+
+    std::shared_ptr<svc::Scene> scene = std::make_shared<svc::Scene>();
+
+    svc::ItemPtr first      = std::make_shared<BasicItem>();
+    svc::ItemPtr second     = std::make_shared<BasicItem>();
+    svc::ItemPtr child      = std::make_shared<BasicItem>();
+    svc::ItemPtr grandchild = std::make_shared<BasicItem>();
+    first->setScenePos(svc::Point{0, 0});
+    second->setScenePos(svc::Point{500, 0});
+    child->setScenePos(svc::Point{100, 100});
+    grandchild->setScenePos(svc::Point{150, 100});
+
+    child->appendChild(grandchild);
+    first->appendChild(child);
+    scene->appendItem(first);
+    scene->appendItem(second);
+
+    scene->setItemFlags(child.get(), Selectable);
+    scene->setItemFlags(grandchild.get(), Selectable | Visible);
+
+    svc::Box box{svc::Point{90, 90}, svc::Point{160, 110}};
+    svc::Box bounds = scene->bounds();
+
+    WHEN("move child to other parent in the Scene") {
+      second->appendChild(child);
+
+      THEN("the child and its descendants stay in the Scene with flags") {
+        CHECK(child->getParent() == second.get());
+        CHECK(first->empty());
+        CHECK(child->getScene() == scene.get());
+        CHECK(grandchild->getScene() == scene.get());
+        CHECK(scene->count() == 4);
+
+        CHECK(scene->getItemFlags(child.get()) == Selectable);
+        CHECK(scene->getItemFlags(grandchild.get()) == (Selectable | Visible));
+      }
+
+      THEN("boxes in the index are not changed") {
+        CHECK_POINTS_EQUAL(child->getScenePos(), (svc::Point{100, 100}));
+        CHECK_POINTS_EQUAL(scene->bounds().min_corner(), bounds.min_corner());
+        CHECK_POINTS_EQUAL(scene->bounds().max_corner(), bounds.max_corner());
+
+        svc::ItemList list = scene->query(
+            box, svc::Scene::SpatialIndex::Intersects, {Selectable});
+        CHECK(list.size() == 2);
+
+        list = scene->query(svc::Point{150, 100}, {Selectable | Visible});
+        REQUIRE(list.size() == 1);
+        CHECK(list.front() == grandchild);
+      }
+
+      AND_WHEN("move new parent") {
+        second->moveOn(svc::Point{0, 300});
+
+        THEN("the child is moved with new parent and saves its flags") {
+          CHECK_POINTS_EQUAL(child->getScenePos(), (svc::Point{100, 400}));
+          CHECK(scene->query(box).empty());
+
+          svc::ItemList list =
+              scene->query(svc::Point{150, 400}, {Selectable | Visible});
+          REQUIRE(list.size() == 1);
+          CHECK(list.front() == grandchild);
+        }
+      }
+
+      AND_WHEN("move old parent") {
+        first->moveOn(svc::Point{0, 300});
+
+        THEN("the child doesn't follow old parent") {
+          CHECK_POINTS_EQUAL(child->getScenePos(), (svc::Point{100, 100}));
+          CHECK(scene->query(box).size() == 2);
+        }
+      }
+    }
+  }
+
+  GIVEN("Scene with Items on one line") {
+    std::shared_ptr<svc::Scene> scene = std::make_shared<svc::Scene>();
+
+    svc::ItemPtr first  = std::make_shared<BasicItem>();
+    svc::ItemPtr second = std::make_shared<BasicItem>();
+    svc::ItemPtr third  = std::make_shared<BasicItem>();
+    first->setScenePos(svc::Point{100, 0});
+    second->setScenePos(svc::Point{50, 0});
+    third->setScenePos(svc::Point{150, 0});
+
+    scene->appendItem(first);
+    scene->appendItem(second);
+    scene->appendItem(third);
+
+    WHEN("cast ray through all Items") {
+      std::optional<svc::RayHit> hit =
+          scene->raycast(svc::Point{0, 0}, svc::Point{1, 0}, 1000);
+
+      THEN("the ray hits nearest Item") {
+        REQUIRE(hit);
+        CHECK(hit->item == second);
+        CHECK(Approx{hit->distance} == 45);
+      }
+    }
+
+    WHEN("cast ray in opposite direction") {
+      std::optional<svc::RayHit> hit =
+          scene->raycast(svc::Point{200, 0}, svc::Point{-1, 0}, 1000);
+
+      THEN("the ray hits nearest Item from other side") {
+        REQUIRE(hit);
+        CHECK(hit->item == third);
+        CHECK(Approx{hit->distance} == 45);
+      }
+    }
+
+    WHEN("ray is too short") {
+      THEN("nothing is hit") {
+        CHECK_FALSE(scene->raycast(svc::Point{0, 0}, svc::Point{1, 0}, 40));
+      }
+    }
+
+    WHEN("ray goes by") {
+      THEN("nothing is hit") {
+        CHECK_FALSE(scene->raycast(svc::Point{0, 10}, svc::Point{1, 0}, 1000));
+      }
+    }
+
+    WHEN("query by segment") {
+      svc::ItemList list =
+          scene->query(svc::Segment{svc::Point{0, 0}, svc::Point{120, 0}});
+
+      THEN("list contains intersected Items in order along the segment") {
+        REQUIRE(list.size() == 2);
+        CHECK(list.front() == second);
+        CHECK(list.back() == first);
+      }
+    }
+
+    WHEN("rotate Item and cast ray by corner of its index box") {
+      second->setSceneRotation(TO_RAD(45));
+
+      svc::Point origin{50 - 4.5, -20};
+      svc::Point direction{0, 1};
+
+      THEN("without refinement the ray hits index box of the Item") {
+        std::optional<svc::RayHit> hit = scene->raycast(origin, direction, 40);
+        REQUIRE(hit);
+        CHECK(hit->item == second);
+      }
+
+      THEN("with refinement the ray hits rotated bounding box of the Item "
+           "later") {
+        std::optional<svc::RayHit> hit =
+            scene->raycast(origin,
+                           direction,
+                           40,
+                           {},
+                           svc::Scene::Refinement::BoundingShape);
+        REQUIRE(hit);
+        CHECK(hit->item == second);
+        CHECK(hit->distance > 15.5f);
+      }
+    }
+  }
+
+  GIVEN("Scene with Items in corners of square") {
+    std::shared_ptr<svc::Scene> scene = std::make_shared<svc::Scene>();
+
+    svc::ItemPtr leftBottom  = std::make_shared<BasicItem>();
+    svc::ItemPtr leftTop     = std::make_shared<BasicItem>();
+    svc::ItemPtr rightTop    = std::make_shared<BasicItem>();
+    svc::ItemPtr rightBottom = std::make_shared<BasicItem>();
+    svc::ItemPtr center      = std::make_shared<BasicItem>();
+    leftBottom->setScenePos(svc::Point{0, 0});
+    leftTop->setScenePos(svc::Point{0, 100});
+    rightTop->setScenePos(svc::Point{100, 100});
+    rightBottom->setScenePos(svc::Point{100, 0});
+    center->setScenePos(svc::Point{50, 50});
+
+    scene->appendItem(leftBottom);
+    scene->appendItem(leftTop);
+    scene->appendItem(rightTop);
+    scene->appendItem(rightBottom);
+    scene->appendItem(center);
+
+    // clockwised "U" shape, which covers all corners except right top and
+    // doesn't cover center
+    svc::Ring uShape{{-10, -10},
+                     {-10, 110},
+                     {20, 110},
+                     {20, 20},
+                     {80, 20},
+                     {80, 80},
+                     {110, 80},
+                     {110, -10}};
+
+    WHEN("query by non-convex ring") {
+      svc::ItemList list = scene->query(uShape);
+
+      THEN("list contains only Items covered by the ring") {
+        CHECK(list.size() == 3);
+        CHECK(std::find(list.begin(), list.end(), center) == list.end());
+        CHECK(std::find(list.begin(), list.end(), rightTop) == list.end());
+      }
+    }
+
+    WHEN("query by polygon with hole") {
+      svc::Polygon polygon;
+      polygon.outer() = {{-10, -10}, {-10, 110}, {110, 110}, {110, -10}};
+      polygon.inners().push_back({{20, 20}, {80, 20}, {80, 80}, {20, 80}});
+
+      svc::ItemList list = scene->query(polygon);
+
+      THEN("list doesn't contain Item in the hole") {
+        CHECK(list.size() == 4);
+        CHECK(std::find(list.begin(), list.end(), center) == list.end());
+      }
+
+      THEN("within query also ignore Item in the hole") {
+        CHECK(scene->query(polygon, svc::Scene::SpatialIndex::Within).size() ==
+              4);
+      }
+    }
+
+    WHEN("query by multi polygon") {
+      svc::Polygon first;
+      first.outer() = {{-10, -10}, {-10, 10}, {10, 10}, {10, -10}};
+      svc::Polygon second;
+      second.outer() = {{40, 40}, {40, 110}, {110, 110}, {110, 40}};
+
+      svc::MultiPolygon multiPolygon{first, second};
+
+      svc::ItemList list = scene->query(multiPolygon);
+
+      THEN("list contains Items from both polygons") {
+        CHECK(list.size() == 3);
+        CHECK(std::find(list.begin(), list.end(), leftBottom) != list.end());
+        CHECK(std::find(list.begin(), list.end(), rightTop) != list.end());
+        CHECK(std::find(list.begin(), list.end(), center) != list.end());
+      }
+    }
+
+    WHEN("query by empty multi polygon") {
+      svc::MultiPolygon multiPolygon;
+
+      THEN("list is empty") {
+        CHECK(scene->query(multiPolygon).empty());
+        CHECK(scene->query(multiPolygon, svc::Scene::SpatialIndex::Within)
+                  .empty());
+      }
+    }
+  }
+
+  GIVEN("Scene with Items on different distances from center") {
+    std::shared_ptr<svc::Scene> scene = std::make_shared<svc::Scene>();
+
+    svc::Point center = POINT_GENERATOR(FIRST_LEVEL_GENERATOR);
+
+    svc::ItemPtr nearest  = std::make_shared<BasicItem>();
+    svc::ItemPtr middle   = std::make_shared<BasicItem>();
+    svc::ItemPtr diagonal = std::make_shared<BasicItem>();
+    svc::ItemPtr farthest = std::make_shared<BasicItem>();
+    nearest->setScenePos(center + svc::Point{10, 0});
+    middle->setScenePos(center + svc::Point{0, -50});
+    // corner of index box of the Item is on distance ~71 from center, but the
+    // Item is inside bounding box of circle with radius 60
+    diagonal->setScenePos(center + svc::Point{55, 55});
+    farthest->setScenePos(center + svc::Point{-200, 0});
+
+    scene->appendItem(farthest);
+    scene->appendItem(diagonal);
+    scene->appendItem(middle);
+    scene->appendItem(nearest);
+
+    WHEN("query by radius") {
+      svc::ItemList list = scene->queryRadius(center, 60);
+
+      THEN("list contains only Items, which intersect the circle") {
+        CHECK(list.size() == 2);
+        CHECK(std::find(list.begin(), list.end(), diagonal) == list.end());
+        CHECK(std::find(list.begin(), list.end(), farthest) == list.end());
+      }
+    }
+
+    WHEN("query by radius with sorting") {
+      svc::ItemList list = scene->queryRadiusSorted(center, 1000);
+
+      THEN("list contains all Items sorted by distance") {
+        REQUIRE(list.size() == 4);
+        CHECK(list.front() == nearest);
+        CHECK(*std::next(list.begin()) == middle);
+        CHECK(*std::next(list.begin(), 2) == diagonal);
+        CHECK(list.back() == farthest);
+      }
+    }
+
+    WHEN("query by small radius with sorting") {
+      svc::ItemList list = scene->queryRadiusSorted(center, 60);
+
+      THEN("traversing stops on first Item outside the circle") {
+        REQUIRE(list.size() == 2);
+        CHECK(list.front() == nearest);
+        CHECK(list.back() == middle);
+      }
+    }
+  }
+
+  GIVEN("two Scenes and group of Items in some region of first Scene") {
+    std::shared_ptr<svc::Scene> source      = std::make_shared<svc::Scene>();
+    std::shared_ptr<svc::Scene> destination = std::make_shared<svc::Scene>();
+
+    svc::Box region{{0, 0}, {100, 100}};
+
+    svc::ItemPtr parent = std::make_shared<BasicItem>();
+    svc::ItemPtr child  = std::make_shared<BasicItem>();
+    parent->appendChild(child);
+    parent->setScenePos(svc::Point{50, 50});
+    child->setScenePos(svc::Point{500, 500}); // child is out of the region
+    source->appendItem(parent);
+    source->setItemFlags(child.get(), 1);
+
+    size_t itemCount = 10;
+    for (size_t i = 0; i < itemCount; ++i) {
+      svc::ItemPtr item = std::make_shared<BasicItem>();
+      item->setScenePos(svc::Point{float(i * 10), 0});
+      source->appendItem(item);
+    }
+
+    svc::ItemPtr outside = std::make_shared<BasicItem>();
+    outside->setScenePos(svc::Point{-500, -500});
+    source->appendItem(outside);
+
+    svc::ItemPtr alreadyInDestination = std::make_shared<BasicItem>();
+    destination->appendItem(alreadyInDestination);
+
+    WHEN("transfer the region to second Scene") {
+      destination->transferFrom(*source, region);
+
+      THEN("all Items from the region are moved with its children") {
+        CHECK(source->count() == 1);
+        CHECK(destination->count() == itemCount + 3);
+
+        CHECK(parent->getScene() == destination.get());
+        CHECK(child->getScene() == destination.get());
+        CHECK(child->getParent() == parent.get());
+        CHECK(outside->getScene() == source.get());
+      }
+
+      THEN("moved Items save its flags and positions") {
+        CHECK(destination->getItemFlags(child.get()) == 1);
+
+        CHECK(destination->query(svc::Point{500, 500}).size() == 1);
+        CHECK(destination->query(svc::Point{50, 50}).size() == 1);
+        CHECK(destination->query(svc::Point{50, 0}).size() == 1);
+        CHECK(source->query(svc::Point{50, 50}).empty());
+      }
+    }
+
+    WHEN("extract the region") {
+      svc::ItemList roots = source->extract(region);
+
+      THEN("only root Items are returned, but children also removed") {
+        CHECK(roots.size() == itemCount + 1);
+        CHECK(source->count() == 1);
+
+        CHECK(parent->getScene() == nullptr);
+        CHECK(child->getScene() == nullptr);
+        CHECK(child->getParent() == parent.get());
+      }
+
+      THEN("removed Items can not be found by query") {
+        CHECK(source->query(region).empty());
+        CHECK(source->query(svc::Point{-500, -500}).size() == 1);
+      }
+    }
+  }
+
+  GIVEN("Scene with Items and its snapshot") {
+    std::shared_ptr<svc::Scene> scene = std::make_shared<svc::Scene>();
+
+    svc::ItemPtr parent = std::make_shared<BasicItem>();
+    svc::ItemPtr child  = std::make_shared<BasicItem>();
+    svc::ItemPtr other  = std::make_shared<BasicItem>();
+    parent->appendChild(child);
+    parent->setScenePos(svc::Point{0, 0});
+    child->setScenePos(svc::Point{100, 0});
+    other->setScenePos(svc::Point{-100, 0});
+
+    scene->appendItem(parent);
+    scene->appendItem(other);
+
+    svc::SceneSnapshotPtr snapshot = scene->snapshot();
+
+    THEN("snapshot contains all Items") {
+      CHECK(snapshot->count() == 3);
+      CHECK(snapshot->query(svc::Point{100, 0}).size() == 1);
+      REQUIRE(snapshot->getSceneMatrix(child.get()));
+      CHECK_POINTS_EQUAL(svc::Point(bq::translation(
+                             *snapshot->getSceneMatrix(child.get()))),
+                         child->getScenePos());
+    }
+
+    WHEN("change the Scene") {
+      parent->setScenePos(svc::Point{0, 500});
+      scene->removeItem(other.get());
+
+      THEN("snapshot is not changed") {
+        CHECK(snapshot->count() == 3);
+        CHECK(snapshot->query(svc::Point{100, 0}).size() == 1);
+        CHECK(snapshot->query(svc::Point{-100, 0}).size() == 1);
+      }
+
+      THEN("new snapshots contain the changes") {
+        // take several snapshots for check both buffers
+        for (int i = 0; i < 3; ++i) {
+          svc::SceneSnapshotPtr newSnapshot = scene->snapshot();
+
+          CHECK(newSnapshot->count() == 2);
+          CHECK(newSnapshot->query(svc::Point{100, 500}).size() == 1);
+          CHECK(newSnapshot->query(svc::Point{-100, 0}).empty());
+          CHECK_FALSE(newSnapshot->getSceneMatrix(other.get()));
+        }
+      }
+    }
+
+    WHEN("rotate parent around its center") {
+      snapshot.reset();
+      scene->snapshot();
+
+      parent->setRotation(TO_RAD(90));
+
+      THEN("Scene matrices of parent and child in new snapshot are changed") {
+        svc::SceneSnapshotPtr newSnapshot = scene->snapshot();
+
+        CHECK_ANGLES_EQUAL(
+            svc::getRotation(*newSnapshot->getSceneMatrix(parent.get())),
+            parent->getSceneRotation());
+        CHECK_POINTS_EQUAL(svc::Point(bq::translation(
+                               *newSnapshot->getSceneMatrix(child.get()))),
+                           child->getScenePos());
+      }
+    }
+
+    WHEN("read snapshots from other thread while the Scene is changing") {
+      std::atomic<bool>     stop{false};
+      svc::SceneSnapshotPtr shared = scene->snapshot();
+      std::mutex            sharedMutex;
+
+      std::thread reader{[&stop, &shared, &sharedMutex]() {
+        while (stop == false) {
+          svc::SceneSnapshotPtr current;
+          {
+            std::lock_guard<std::mutex> lock{sharedMutex};
+            current = shared;
+          }
+          current->query(svc::Box{{-1000, -1000}, {1000, 1000}});
+        }
+      }};
+
+      for (int i = 0; i < 100; ++i) {
+        parent->setScenePos(svc::Point{float(i), 0});
+
+        svc::SceneSnapshotPtr next = scene->snapshot();
+        std::lock_guard<std::mutex> lock{sharedMutex};
+        shared = next;
+      }
+
+      stop = true;
+      reader.join();
+
+      THEN("last snapshot contains last state") {
+        CHECK(shared->query(svc::Point{199, 0}).size() == 1);
+      }
+    }
+
+    WHEN("release snapshot with removed Item by other thread") {
+      std::weak_ptr<svc::AbstractItem> removed = other;
+      scene->removeItem(other.get());
+      other.reset();
+
+      std::thread reader{[snapshot = std::move(snapshot)]() mutable {
+        CHECK(snapshot->count() == 3);
+        snapshot.reset();
+      }};
+      reader.join();
+
+      THEN("the Item is still held by the Scene") {
+        CHECK(removed.expired() == false);
+      }
+
+      THEN("the Item is released when the snapshot is updated") {
+        // first call uses other buffer, second one updates released snapshot
+        scene->snapshot();
+        scene->snapshot();
+        CHECK(removed.expired());
+      }
+    }
+
+    WHEN("the Scene is destroyed before the snapshot") {
+      std::weak_ptr<svc::AbstractItem> weakOther = other;
+      other.reset();
+      scene.reset();
+
+      THEN("the snapshot is still valid and holds its Items") {
+        CHECK(snapshot->count() == 3);
+        CHECK(snapshot->query(svc::Point{-100, 0}).size() == 1);
+        CHECK(weakOther.expired() == false);
+
+        snapshot.reset();
+        CHECK(weakOther.expired());
+      }
+    }
+  }
+  GIVEN("Scene with user memory resource") {
+    CountingResource                       counter;
+    std::pmr::unsynchronized_pool_resource pool{&counter};
+    svc::Scene                             scene{&pool};
+
+    std::vector<svc::ItemPtr> items;
+    for (int i = 0; i < 1000; ++i) {
+      svc::ItemPtr item = std::make_shared<BasicItem>();
+      item->setScenePos(svc::Point{float(i % 50) * 20, float(i / 50) * 20});
+      items.emplace_back(std::move(item));
+    }
+
+    WHEN("append Items") {
+      for (svc::ItemPtr &item : items) {
+        scene.appendItem(item);
+      }
+
+      THEN("the resource is used by the Scene") {
+        CHECK(counter.allocations != 0);
+        CHECK(scene.count() == items.size());
+        CHECK(scene.query(svc::Point{20, 20}).size() == 1);
+      }
+
+      AND_WHEN("remove Items") {
+        for (const svc::ItemPtr &item : items) {
+          scene.removeItem(item.get());
+        }
+
+        THEN("Scene is empty") {
+          CHECK(scene.empty());
+        }
+      }
+    }
+
+    WHEN("reserve memory and append Items") {
+      scene.reserve(items.size());
+      size_t reserved = counter.allocations;
+
+      for (svc::ItemPtr &item : items) {
+        scene.appendItem(item);
+      }
+
+      THEN("appending doesn't allocate memory from upstream") {
+        CHECK(counter.allocations == reserved);
+        CHECK(scene.count() == items.size());
+      }
+    }
+  }
+  GIVEN("Scene for collecting statistic") {
+    svc::Scene scene;
+
+    svc::ItemPtr item = std::make_shared<BasicItem>();
+
+    WHEN("do some operations") {
+      scene.appendItem(item);
+      item->setScenePos(svc::Point{10, 10});
+      scene.query(svc::Point{10, 10});
+      scene.query(svc::Point{1000, 1000});
+      scene.removeItem(item.get());
+
+      svc::SceneStats stats = scene.stats();
+
+#ifdef SVC_SCENE_STATS
+      THEN("all operations are counted") {
+        REQUIRE(stats.enabled);
+        CHECK(stats[svc::SceneOperation::Append].count == 1);
+        CHECK(stats[svc::SceneOperation::Update].count == 1);
+        CHECK(stats[svc::SceneOperation::Remove].count == 1);
+        CHECK(stats[svc::SceneOperation::Query].count == 2);
+        CHECK(stats[svc::SceneOperation::Query].hits == 1);
+        CHECK(stats[svc::SceneOperation::Query].candidates == 1);
+        CHECK(stats[svc::SceneOperation::Query].latency.count() == 2);
+      }
+
+      AND_WHEN("reset statistic") {
+        scene.stats(true);
+
+        THEN("counters are zero") {
+          stats = scene.stats();
+          CHECK(stats[svc::SceneOperation::Query].count == 0);
+          CHECK(stats[svc::SceneOperation::Query].latency.count() == 0);
+        }
+      }
+#else
+      THEN("statistic is not collected") {
+        CHECK(stats.enabled == false);
+        CHECK(stats[svc::SceneOperation::Query].count == 0);
+      }
+#endif
+
+      THEN("statistic can be written as JSON and Prometheus text") {
+        std::ostringstream json;
+        stats.write(json, svc::SceneStats::Format::Json);
+        CHECK(json.str().find("\"query\"") != std::string::npos);
+
+        std::ostringstream prometheus;
+        stats.write(prometheus, svc::SceneStats::Format::Prometheus);
+        CHECK(prometheus.str().find(
+                  "svc_scene_operations_total{operation=\"query\"}") !=
+              std::string::npos);
+      }
+    }
+  }
+
+  GIVEN("latency histogram") {
+    svc::LatencyHistogram histogram;
+
+    for (uint64_t i = 1; i <= 10000; ++i) {
+      histogram.record(i);
+    }
+
+    THEN("percentiles have bounded relative error") {
+      CHECK(histogram.count() == 10000);
+      CHECK(histogram.min() == 1);
+      CHECK(histogram.max() == 10000);
+      CHECK(histogram.percentile(0.5) == Approx(5000).epsilon(0.07));
+      CHECK(histogram.percentile(0.99) == Approx(9900).epsilon(0.07));
+      CHECK(histogram.percentile(1) == 10000);
+    }
+
+    THEN("every value is inside bounds of its bucket") {
+      for (uint64_t value : {0ul, 15ul, 16ul, 17ul, 1000ul, 123456789ul}) {
+        size_t index = svc::LatencyHistogram::bucketIndex(value);
+        CHECK(svc::LatencyHistogram::bucketLowerBound(index) <= value);
+        CHECK(svc::LatencyHistogram::bucketUpperBound(index) >= value);
+      }
+    }
+  }
 }
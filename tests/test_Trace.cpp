@@ -0,0 +1,103 @@
+// test_Trace.cpp
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch.hpp>
+
+//
+
+#include "trace.hpp"
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+/**\return count of not overlapped occurrences of the pattern
+ */
+static size_t countOf(const std::string &str, const std::string &pattern) {
+  size_t retval = 0;
+  for (size_t pos = str.find(pattern); pos != str.npos;
+       pos        = str.find(pattern, pos + pattern.size())) {
+    ++retval;
+  }
+  return retval;
+}
+
+/**\return thread id of first span with the name
+ */
+static std::string threadIdOf(const std::string &json,
+                              const std::string &name) {
+  std::string prefix = "\"name\": \"" + name +
+                       "\", \"ph\": \"X\", \"pid\": 1, \"tid\": ";
+  size_t pos = json.find(prefix);
+  REQUIRE(pos != json.npos);
+  pos += prefix.size();
+  return json.substr(pos, json.find(',', pos) - pos);
+}
+
+static std::string writeTrace() {
+  std::ostringstream out;
+  trace::Tracer::get().write(out);
+  return out.str();
+}
+
+SCENARIO("writing of spans in Chrome trace format", "[trace]") {
+  GIVEN("spans written by current thread") {
+    {
+      trace::Scope outer{"test outer"};
+      trace::Scope inner{"test inner"};
+    }
+
+    std::string json = writeTrace();
+
+    THEN("output is JSON object with array of events") {
+      CHECK(json.rfind("{\"displayTimeUnit\": \"ns\", \"traceEvents\": [", 0) ==
+            0);
+      CHECK(json.size() >= 4);
+      CHECK(json.substr(json.size() - 4) == "\n]}\n");
+    }
+
+    THEN("every span is complete event with time in microseconds") {
+      std::regex event{"\\{\"name\": \"test outer\", \"ph\": \"X\", "
+                       "\"pid\": 1, \"tid\": [0-9]+, "
+                       "\"ts\": [0-9]+\\.[0-9]{3}, "
+                       "\"dur\": [0-9]+\\.[0-9]{3}\\}"};
+      CHECK(std::regex_search(json, event));
+      CHECK(countOf(json, "\"name\": \"test inner\"") >= 1);
+    }
+  }
+
+  GIVEN("span with special characters in name") {
+    { trace::Scope scope{"quote \" backslash \\ line\nend\ttab"}; }
+
+    std::string json = writeTrace();
+
+    THEN("the name is escaped") {
+      std::string escaped =
+          R"("name": "quote \" backslash \\ line\u000aend\u0009tab")";
+      CHECK(json.find(escaped) != std::string::npos);
+    }
+  }
+
+  GIVEN("spans written by other thread") {
+    { trace::Scope scope{"test current thread"}; }
+
+    std::thread thread{[]() {
+      for (size_t i = 0; i < TRACE_BUFFER_SIZE + 5; ++i) {
+        trace::Scope scope{"test other thread"};
+      }
+    }};
+    thread.join();
+
+    std::string json = writeTrace();
+
+    THEN("spans, which don't fit the buffer, are counted as dropped and the "
+         "thread has own id") {
+      CHECK(countOf(json, "\"name\": \"test other thread\"") ==
+            TRACE_BUFFER_SIZE);
+      CHECK(json.find("\"args\": {\"dropped\": 5}") != std::string::npos);
+
+      CHECK(threadIdOf(json, "test other thread") !=
+            threadIdOf(json, "test current thread"));
+    }
+  }
+}
@@ -62,6 +62,22 @@ public:
   int count_;
 };
 
+/**\brief removes every visited Item from its Scene
+ */
+class RemoveVisitor final : public svc::AbstractVisitor {
+public:
+  RemoveVisitor()
+      : count_{0} {
+  }
+
+  void visit(BasicItem *item) override {
+    item->getScene()->removeItem(item);
+    ++count_;
+  }
+
+  int count_;
+};
+
 SCENARIO("test View", "[View]") {
   GIVEN("empty view") {
     View view;
@@ -163,6 +179,21 @@ SCENARIO("test View", "[View]") {
       }
     }
 
+    WHEN("map several points at once") {
+      view.rotateSceneRect(ANGLE_GENERATOR(1));
+
+      svc::Point viewPoints[] = {{0, 0}, {10, 0}, {10, 10}, {0, 10}, {5, 5}};
+      svc::Point scenePoints[std::size(viewPoints)];
+      view.mapToScene(viewPoints, scenePoints, std::size(viewPoints));
+
+      THEN("every point must be mapped same as by single mapping") {
+        for (size_t i = 0; i < std::size(viewPoints); ++i) {
+          svc::Point expected = view.mapToScene(viewPoints[i]);
+          CHECK_POINTS_EQUAL(scenePoints[i], expected);
+        }
+      }
+    }
+
     WHEN("rotate scene rect around default anchor") {
       float newAngle = ANGLE_GENERATOR(SECOND_LEVEL_GENERATOR);
 
@@ -293,4 +324,68 @@ SCENARIO("test View", "[View]") {
       }
     }
   }
+
+  GIVEN("View and Scene, which is only owner of its Items") {
+    View          view;
+    svc::ScenePtr scene = std::make_shared<svc::Scene>();
+
+    std::vector<std::weak_ptr<svc::AbstractItem>> items;
+    for (int i = 0; i < 10; ++i) {
+      svc::ItemPtr item = std::make_shared<BasicItem>();
+      item->setScenePos(svc::Point{float(i * 10), float(i * 10)});
+      scene->appendItem(item);
+      items.emplace_back(item);
+    }
+
+    view.setScene(scene);
+    view.setSceneRect(svc::Rect{svc::Point{0, 0}, svc::Size{200, 200}, 0});
+
+    WHEN("visitor removes visited Items from the Scene") {
+      RemoveVisitor remover;
+      view.accept(&remover);
+
+      THEN("all Items are visited and removed") {
+        CHECK(remover.count_ == 10);
+        CHECK(scene->empty());
+      }
+
+      THEN("the View doesn't hold removed Items after visiting") {
+        for (const std::weak_ptr<svc::AbstractItem> &item : items) {
+          CHECK(item.expired());
+        }
+      }
+    }
+  }
+
+  GIVEN("View and snapshot of Scene with several Items") {
+    View          view;
+    svc::ScenePtr scene = std::make_shared<svc::Scene>();
+
+    svc::ItemPtr item1 = std::make_shared<BasicItem>();
+    svc::ItemPtr item2 = std::make_shared<BasicItem>();
+    item1->setScenePos(svc::Point{10, 10});
+    item2->setScenePos(svc::Point{50, 50});
+
+    scene->appendItem(item1);
+    scene->appendItem(item2);
+
+    view.setScene(scene);
+    view.setSceneRect(svc::Rect{svc::Point{0, 0}, svc::Size{100, 100}, 0});
+
+    svc::SceneSnapshotPtr snapshot = scene->snapshot();
+
+    WHEN("move Item out of scene rect after taking snapshot") {
+      item2->setScenePos(svc::Point{500, 500});
+
+      THEN("the View visits Items by state of the snapshot") {
+        CountVisitor snapshotCounter;
+        view.accept(&snapshotCounter, *snapshot);
+        CHECK(snapshotCounter.count_ == 2);
+
+        CountVisitor sceneCounter;
+        view.accept(&sceneCounter);
+        CHECK(sceneCounter.count_ == 1);
+      }
+    }
+  }
 }
@@ -0,0 +1,54 @@
+// log_decoder.cpp
+/**\file prints binary log in STANDARD_LOG_FORMAT
+ *
+ * Usage: log_decoder FILE
+ *
+ * \see binary_logs.hpp
+ */
+
+#include "binary_logs.hpp"
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    std::cerr << "usage: " << argv[0] << " FILE" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::ifstream fin{argv[1], std::ios::in | std::ios::binary};
+  if (fin.is_open() == false) {
+    std::cerr << "can not open file " << argv[1] << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::vector<char> data{std::istreambuf_iterator<char>{fin},
+                         std::istreambuf_iterator<char>{}};
+
+  logs::binary::Decoder decoder{data.data(), data.size()};
+  if (decoder.isValid() == false) {
+    std::cerr << "invalid binary log " << argv[1] << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  size_t count = decoder.decode(
+      [](const logs::FormatInfo &                          info,
+         std::chrono::time_point<std::chrono::system_clock> timePoint,
+         uint64_t                                           threadId,
+         boost::format                                      message) {
+        std::cout << logs::getRecord(info.severity,
+                                     info.fileName,
+                                     info.lineNumber,
+                                     info.functionName,
+                                     timePoint,
+                                     threadId,
+                                     std::move(message))
+                  << '\n';
+      });
+
+  std::cerr << "records: " << count
+            << ", dropped: " << decoder.getHeader().dropped
+            << ", invalid: " << decoder.invalid() << std::endl;
+
+  return EXIT_SUCCESS;
+}